@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "ccpp.bench.hpp"
+#include "ccpp.compiler.hpp"
+#include "ccpp.corpus.hpp"
+#include "ccpp.cps.hpp"
+#include "ccpp.evaluator.hpp"
+#include "ccpp.incremental.hpp"
+#include "ccpp.optimizer.hpp"
+#include "ccpp.parallel_lexer.hpp"
+#include "ccpp.parallel_parser.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.scan.hpp"
+#include "ccpp.vm.hpp"
+
+// ccpp.bench [--runs N] [--warmup N] [--size BYTES] [--seed N] [--filter TEXT] [--json FILE]:
+// times input_stream, token_stream, parallel_lexer and both parsers on each generated
+// corpus and the engines on a few programs, prints the results and writes them as json
+// to FILE (`-` for stdout) so runs of different releases can be diffed. --filter runs
+// only the benchmarks whose name contains TEXT. parser/scaling/* parse sizes from 1 KB
+// to 100 MB to show parse time grows linearly, incremental/* time a one-character edit
+// in a 5 MB source, threads16/* parse on 16 threads at once, with the global heap and
+// with a monotonic buffer per thread
+namespace
+{
+    // keeps the work a benchmark does from being optimized away
+    volatile std::size_t sink;
+
+#ifdef __VERSION__
+    constexpr const char *compiler_version = __VERSION__;
+#else
+    constexpr const char *compiler_version = "unknown";
+#endif
+
+    ccpp::ast parse(std::string_view source)
+    {
+        return ccpp::parser{ccpp::token_stream(ccpp::input_stream(source))}.parse();
+    }
+
+    void front_end(ccpp::bench::harness &h, const ccpp::corpus::generator &gen, std::size_t size, std::uint32_t seed)
+    {
+        auto name = std::string(gen.name);
+        if (!h.selected("input_stream/" + name) && !h.selected("token_stream/" + name) && !h.selected("parallel_lexer/" + name) &&
+            !h.selected("parser/" + name) && !h.selected("parallel_parser/" + name))
+            return;
+        auto source = gen.make(size, seed);
+        auto bytes = static_cast<double>(source.size());
+
+        h.measure("input_stream/" + name, "bytes", bytes, [&]()
+                  {
+            ccpp::input_stream is{std::string_view(source)};
+            std::size_t sum = 0;
+            while (!is.eof())
+                sum += static_cast<unsigned char>(is.next());
+            sink = sum; });
+        h.measure("token_stream/" + name, "bytes", bytes, [&]()
+                  {
+            ccpp::token_stream ts{ccpp::input_stream(std::string_view(source))};
+            std::size_t tokens = 0;
+            while (!ts.eof())
+            {
+                ts.next();
+                tokens++;
+            }
+            sink = tokens; });
+        h.measure("parallel_lexer/" + name, "bytes", bytes, [&]()
+                  { sink = ccpp::parallel_lexer(ccpp::input_stream(std::string_view(source))).lex().size(); });
+        auto nodes = static_cast<double>(parse(source).nodes());
+        h.measure("parser/" + name, "nodes", nodes, [&]()
+                  { sink = parse(source).nodes(); });
+        // lexed once up front, so unlike parser/* this leaves out the lexing.
+        // each run parses a copy of the tokens
+        ccpp::parallel_lexer lexer{ccpp::input_stream(std::string_view(source))};
+        auto tokens = h.selected("parallel_parser/" + name) ? lexer.lex() : std::vector<ccpp::lexeme>{};
+        h.measure("parallel_parser/" + name, "nodes", nodes, [&]()
+                  { sink = ccpp::parallel_parser(ccpp::input_stream(std::string_view(source)), tokens, lexer.symbols()).parse().nodes(); });
+    }
+
+    // the parser over operator_chains from 1 KB to 100 MB, its rate in bytes
+    // should hold flat as the size grows. the names come from a fixed set, so
+    // the symbol table stays small and it is the parser that is measured.
+    // big sizes run fewer times, so the sweep takes about as long as one of
+    // the benchmarks above
+    void scaling(ccpp::bench::harness &h, std::uint32_t seed)
+    {
+        constexpr std::size_t budget = 256 << 20;
+        auto runs = h.runs;
+        auto warmup = h.warmup;
+        for (std::size_t size = 1 << 10, label = 1; size <= std::size_t(100) << 20; size *= 10, label *= 10)
+        {
+            auto name = "parser/scaling/" + (label < 1000 ? std::to_string(label) + "KB" : std::to_string(label / 1000) + "MB");
+            if (!h.selected(name))
+                continue;
+            auto source = ccpp::corpus::operator_chains(size, seed, 50);
+            h.runs = std::clamp<std::size_t>(budget / source.size(), 1, runs);
+            h.warmup = std::clamp<std::size_t>(budget / source.size(), 1, warmup);
+            h.measure(name, "bytes", static_cast<double>(source.size()), [&]()
+                      { sink = parse(source).nodes(); });
+        }
+        h.runs = runs;
+        h.warmup = warmup;
+    }
+
+    // incremental_parser keeping a 5 MB corpus parsed while a space is typed
+    // into the middle of it and deleted again, one edit per run. only the
+    // statements around the edit should be lexed and parsed again
+    void editing(ccpp::bench::harness &h, const ccpp::corpus::generator &gen, std::uint32_t seed)
+    {
+        auto name = "incremental/" + std::string(gen.name);
+        if (!h.selected(name))
+            return;
+        auto source = gen.make(5 << 20, seed);
+        ccpp::incremental_parser inc(source);
+        auto at = std::min(source.find(' ', source.size() / 2), source.size());
+        bool typed = false;
+        h.measure(name, "edits", 1, [&]()
+                  {
+            inc.edit(typed ? ccpp::text_edit{at, 1, ""} : ccpp::text_edit{at, 0, " "});
+            typed = !typed;
+            sink = inc.size(); });
+    }
+
+    // each of `threads` threads parses its own copy of a corpus `rounds` times,
+    // allocating from the default resource or from a monotonic buffer of its
+    // own that is released after every parse, the way a server would give one
+    // to each request
+    void threaded(ccpp::bench::harness &h, const ccpp::corpus::generator &gen, std::size_t size, std::uint32_t seed)
+    {
+        constexpr std::size_t threads = 16;
+        constexpr std::size_t rounds = 4;
+        auto name = std::string(gen.name);
+        if (!h.selected("threads16/default/" + name) && !h.selected("threads16/monotonic/" + name))
+            return;
+        auto source = gen.make(std::max<std::size_t>(size / threads / rounds, 1), seed);
+        auto bytes = static_cast<double>(threads * rounds * source.size());
+
+        auto run = [&](bool monotonic)
+        {
+            std::atomic<std::size_t> nodes = 0;
+            std::vector<std::thread> pool;
+            for (std::size_t t = 0; t < threads; t++)
+                pool.emplace_back([&, copy = source]()
+                                  {
+                    // the tree takes a few times the source, more is asked of
+                    // the heap when it does not fit
+                    auto capacity = monotonic ? 8 * copy.size() + (1 << 20) : 1;
+                    auto buffer = std::make_unique_for_overwrite<std::byte[]>(capacity);
+                    std::pmr::monotonic_buffer_resource arena(buffer.get(), capacity);
+                    auto resource = monotonic ? &arena : std::pmr::get_default_resource();
+                    std::size_t sum = 0;
+                    for (std::size_t r = 0; r < rounds; r++)
+                    {
+                        sum += ccpp::parser{ccpp::token_stream(ccpp::input_stream(std::string_view(copy)), resource)}.parse().nodes();
+                        arena.release();
+                    }
+                    nodes += sum; });
+            for (auto &thread : pool)
+                thread.join();
+            sink = nodes;
+        };
+        h.measure("threads16/default/" + name, "bytes", bytes, [&]()
+                  { run(false); });
+        h.measure("threads16/monotonic/" + name, "bytes", bytes, [&]()
+                  { run(true); });
+    }
+
+    void engines(ccpp::bench::harness &h, const ccpp::corpus::program &prog)
+    {
+        std::ostream out(nullptr);
+        auto calls = static_cast<double>(prog.calls);
+        // each engine gets a tree of its own, resolving binds it in place
+        auto tree = ccpp::optimizer(parse(prog.source)).optimize();
+        h.measure(
+            "evaluator/" + prog.name, "calls", calls, [&]()
+            { return std::make_unique<ccpp::evaluator>(tree, out); },
+            [&](std::unique_ptr<ccpp::evaluator> &e)
+            { e->run(); });
+
+        auto cps_tree = ccpp::optimizer(parse(prog.source)).optimize();
+        h.measure(
+            "cps/" + prog.name, "calls", calls, [&]()
+            { return std::make_unique<ccpp::cps_evaluator>(cps_tree, out); },
+            [&](std::unique_ptr<ccpp::cps_evaluator> &e)
+            { e->run(); });
+
+        auto vm_tree = ccpp::optimizer(parse(prog.source)).optimize();
+        auto code = ccpp::compiler(vm_tree).compile();
+        ccpp::vm::counters count;
+        auto r = h.measure(
+            "vm/" + prog.name, "calls", calls, [&]()
+            { return std::make_unique<ccpp::vm>(code, vm_tree.symbols, out); },
+            [&](std::unique_ptr<ccpp::vm> &machine)
+            {
+                machine->run();
+                count = machine->allocations; });
+        // the heap frames and closures made for each call, the same every run
+        if (r != nullptr && count.calls > 0)
+        {
+            h.annotate(*r, "frames/call", static_cast<double>(count.frames) / static_cast<double>(count.calls));
+            h.annotate(*r, "closures/call", static_cast<double>(count.closures) / static_cast<double>(count.calls));
+        }
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    ccpp::bench::harness h;
+    std::size_t size = 4 << 20;
+    std::uint32_t seed = 1;
+    const char *json = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "usage: ccpp.bench [--runs N] [--warmup N] [--size BYTES] [--seed N] [--filter TEXT] [--json FILE]" << std::endl;
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--runs")
+            h.runs = std::stoul(value);
+        else if (arg == "--warmup")
+            h.warmup = std::stoul(value);
+        else if (arg == "--size")
+            size = std::stoul(value);
+        else if (arg == "--seed")
+            seed = static_cast<std::uint32_t>(std::stoul(value));
+        else if (arg == "--filter")
+            h.filter = value;
+        else if (arg == "--json")
+            json = argv[i];
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+    h.runs = std::max<std::size_t>(h.runs, 1);
+    h.warmup = std::max<std::size_t>(h.warmup, 1);
+    // the json may be going to stdout
+    h.progress = json != nullptr && std::string_view(json) == "-" ? &std::cerr : &std::cout;
+
+    try
+    {
+        for (auto &gen : ccpp::corpus::generators)
+            front_end(h, gen, size, seed);
+        scaling(h, seed);
+        for (auto &gen : ccpp::corpus::generators)
+            editing(h, gen, seed);
+        for (auto &gen : ccpp::corpus::generators)
+            threaded(h, gen, size, seed);
+        for (auto &prog : {ccpp::corpus::fib(24), ccpp::corpus::closures(50, 200)})
+            engines(h, prog);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (json != nullptr)
+    {
+        std::vector<std::pair<std::string, std::string>> context = {
+            {"compiler", compiler_version},
+            {"scan_kernels", ccpp::scan::active.name},
+            {"corpus_bytes", std::to_string(size)},
+            {"seed", std::to_string(seed)},
+            {"runs", std::to_string(h.runs)},
+            {"warmup", std::to_string(h.warmup)},
+        };
+        if (std::string_view(json) == "-")
+            h.write_json(std::cout, context);
+        else
+        {
+            std::ofstream file(json);
+            h.write_json(file, context);
+            if (!file.flush())
+            {
+                std::cerr << "Can't write " << json << std::endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,620 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ccpp.diagnostics.hpp"
+#include "ccpp.execption.hpp"
+#include "ccpp.operator.hpp"
+#include "ccpp.stats.hpp"
+#include "ccpp.symbol_table.hpp"
+
+namespace ccpp
+{
+    enum class node_kind : std::uint8_t
+    {
+        num_t,    // num_node
+        str_t,    // str_node
+        bool_t,   // bool_node
+        var_t,    // var_node
+        assign_t, // binary_node
+        binary_t, // binary_node
+        call_t,   // call_node + args
+        if_t,     // if_node
+        lambda_t, // lambda_node + vars
+        prog_t,   // prog_node + prog
+    };
+    inline std::string_view to_string(node_kind kind)
+    {
+        switch (kind)
+        {
+        case node_kind::num_t:
+            return "num";
+        case node_kind::str_t:
+            return "str";
+        case node_kind::bool_t:
+            return "bool";
+        case node_kind::var_t:
+            return "var";
+        case node_kind::assign_t:
+            return "assign";
+        case node_kind::binary_t:
+            return "binary";
+        case node_kind::call_t:
+            return "call";
+        case node_kind::if_t:
+            return "if";
+        case node_kind::lambda_t:
+            return "lambda";
+        case node_kind::prog_t:
+            return "prog";
+        }
+        return "unknown";
+    }
+
+    // position of a node in its arena, in 8-byte units
+    using node_id = std::uint32_t;
+    inline constexpr node_id no_node = std::numeric_limits<node_id>::max();
+
+    // slice of the arena's string pool
+    struct text_ref
+    {
+        std::uint32_t offset = 0;
+        std::uint32_t length = 0;
+    };
+
+    // where a var node lives once the resolver has run
+    enum class var_scope : std::uint8_t
+    {
+        unresolved,
+        local,  // head.flags lambdas up, slot head.count of that frame
+        global, // slot head.count of the globals, which is the symbol id
+    };
+
+    // common first member of every node. op is the op_kind of assign/binary and
+    // the var_scope of var, count is the length of the trailing node_id array for
+    // call/lambda/prog and the resolved slot of var
+    struct node
+    {
+        node_kind kind;
+        std::uint8_t op = 0;
+        std::uint16_t flags = 0;
+        std::uint32_t count = 0;
+        source_span span;
+    };
+    struct num_node
+    {
+        node head;
+        double value;
+    };
+    struct str_node
+    {
+        node head;
+        text_ref value;
+    };
+    struct bool_node
+    {
+        node head;
+        bool value;
+    };
+    struct var_node
+    {
+        node head;
+        symbol name;
+    };
+    struct binary_node
+    {
+        node head;
+        node_id left;
+        node_id right;
+    };
+    struct call_node
+    {
+        node head;
+        node_id func;
+        // node_id args[head.count]
+    };
+    struct if_node
+    {
+        node head;
+        node_id cond;
+        node_id then;
+        node_id else_; // no_node without else
+    };
+    struct lambda_node
+    {
+        node head;
+        node_id body;
+        // node_id vars[head.count], each a var node
+    };
+    struct prog_node
+    {
+        node head;
+        // node_id prog[head.count]
+    };
+
+    // where the nodes and strings of one arena go when several are joined.
+    // source is added to the spans, for parts parsed from a slice of the text
+    struct placement
+    {
+        node_id node = 0;
+        std::uint32_t text = 0;
+        std::uint32_t source = 0;
+    };
+
+    // per-parse bump arena: nodes of different sizes packed into one buffer and
+    // linked by 32-bit ids, dropping the tree is a single deallocation. the
+    // arena and the string pool come from `memory`
+    class ast
+    {
+        static constexpr std::size_t unit = 8;
+
+        std::pmr::memory_resource *memory = std::pmr::get_default_resource();
+        std::byte *buffer = nullptr;
+        std::size_t used = 0;
+        std::size_t capacity = 0;
+        std::size_t count = 0;
+        std::pmr::string strings{memory};
+        // set while the nodes are used in place from memory owned elsewhere
+        std::shared_ptr<void> borrowed;
+
+        template <typename Node>
+        static constexpr std::size_t units(std::uint32_t trailing)
+        {
+            return (sizeof(Node) + trailing * sizeof(node_id) + unit - 1) / unit;
+        }
+        void grow(std::size_t need)
+        {
+            std::size_t size = capacity == 0 ? 4096 : capacity * 2;
+            while (size < need)
+                size *= 2;
+            if (size / unit > no_node)
+                throw exception("AST arena exhausted");
+            auto next = static_cast<std::byte *>(memory->allocate(size, unit));
+            if (used != 0)
+                std::memcpy(next, buffer, used);
+            release();
+            buffer = next;
+            capacity = size;
+        }
+        // units taken by a node, trailing ids included
+        static std::size_t size_of(const node &n)
+        {
+            switch (n.kind)
+            {
+            case node_kind::num_t:
+                return units<num_node>(0);
+            case node_kind::str_t:
+                return units<str_node>(0);
+            case node_kind::bool_t:
+                return units<bool_node>(0);
+            case node_kind::var_t:
+                return units<var_node>(0);
+            case node_kind::assign_t:
+            case node_kind::binary_t:
+                return units<binary_node>(0);
+            case node_kind::call_t:
+                return units<call_node>(n.count);
+            case node_kind::if_t:
+                return units<if_node>(0);
+            case node_kind::lambda_t:
+                return units<lambda_node>(n.count);
+            case node_kind::prog_t:
+                return units<prog_node>(n.count);
+            }
+            throw exception("Corrupt AST arena");
+        }
+        // adds `by` to the ids, string offsets and spans of the nodes in
+        // [first, last), which wrap around for nodes moved to a lower id.
+        // returns how many nodes there are
+        std::size_t relocate(node_id first, node_id last, placement by)
+        {
+            auto shift = [&](node_id &id)
+            {
+                if (id != no_node)
+                    id += by.node;
+            };
+            std::size_t nodes = 0;
+            for (auto id = first; id < last; id += static_cast<node_id>(size_of(at(id))), nodes++)
+            {
+                auto &span = get<node>(id).span;
+                span.begin += by.source;
+                span.end += by.source;
+                switch (kind(id))
+                {
+                case node_kind::str_t:
+                    get<str_node>(id).value.offset += by.text;
+                    break;
+                case node_kind::assign_t:
+                case node_kind::binary_t:
+                    shift(get<binary_node>(id).left);
+                    shift(get<binary_node>(id).right);
+                    break;
+                case node_kind::call_t:
+                    shift(get<call_node>(id).func);
+                    for (auto &arg : children<call_node>(id))
+                        shift(arg);
+                    break;
+                case node_kind::if_t:
+                    shift(get<if_node>(id).cond);
+                    shift(get<if_node>(id).then);
+                    shift(get<if_node>(id).else_);
+                    break;
+                case node_kind::lambda_t:
+                    shift(get<lambda_node>(id).body);
+                    for (auto &var : children<lambda_node>(id))
+                        shift(var);
+                    break;
+                case node_kind::prog_t:
+                    for (auto &item : children<prog_node>(id))
+                        shift(item);
+                    break;
+                default:
+                    break;
+                }
+            }
+            return nodes;
+        }
+        void release()
+        {
+            if (borrowed)
+                borrowed.reset();
+            else if (buffer != nullptr)
+                memory->deallocate(buffer, capacity, unit);
+            buffer = nullptr;
+        }
+
+    public:
+        node_id root = no_node;
+        // names of var nodes
+        std::shared_ptr<ccpp::symbol_table> symbols;
+
+        ast() {}
+        explicit ast(std::pmr::memory_resource *memory) : memory(memory) {}
+        ast(const ast &) = delete;
+        ast &operator=(const ast &) = delete;
+        ast(ast &&other) noexcept
+            : memory(other.memory), buffer(std::exchange(other.buffer, nullptr)), used(std::exchange(other.used, 0)),
+              capacity(std::exchange(other.capacity, 0)), count(std::exchange(other.count, 0)), strings(std::move(other.strings)),
+              borrowed(std::move(other.borrowed)), root(std::exchange(other.root, no_node)), symbols(std::move(other.symbols)) {}
+        // the string pool keeps its allocator through an assignment, so the
+        // tree is built anew around the other's memory
+        ast &operator=(ast &&other) noexcept
+        {
+            if (this != &other)
+            {
+                std::destroy_at(this);
+                std::construct_at(this, std::move(other));
+            }
+            return *this;
+        }
+        ~ast() { release(); }
+
+        // bump-allocates a node with room for `trailing` child ids after it
+        template <typename Node>
+        node_id make(node_kind kind, std::uint32_t trailing = 0)
+        {
+            std::size_t size = units<Node>(trailing) * unit;
+            if (used + size > capacity)
+                grow(used + size);
+            auto id = static_cast<node_id>(used / unit);
+            auto ptr = new (buffer + used) Node{};
+            ptr->head.kind = kind;
+            ptr->head.count = trailing;
+            used += size;
+            count++;
+            CCPP_STATS_COUNT(nodes, 1);
+            return id;
+        }
+        template <typename Node>
+        Node &get(node_id id) const
+        {
+            return *std::launder(reinterpret_cast<Node *>(buffer + std::size_t(id) * unit));
+        }
+        const node &at(node_id id) const
+        {
+            return get<node>(id);
+        }
+        node_kind kind(node_id id) const
+        {
+            return at(id).kind;
+        }
+        // the trailing id array of call/lambda/prog nodes
+        template <typename Node>
+        std::span<node_id> children(node_id id) const
+        {
+            auto &n = get<Node>(id);
+            return std::span<node_id>(reinterpret_cast<node_id *>(reinterpret_cast<std::byte *>(&n) + sizeof(Node)), n.head.count);
+        }
+        text_ref intern_text(std::string_view text)
+        {
+            text_ref ref{static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(text.size())};
+            strings.append(text);
+            return ref;
+        }
+        std::string_view text(text_ref ref) const
+        {
+            return std::string_view(strings).substr(ref.offset, ref.length);
+        }
+        // makes room at the end of this arena for the nodes and strings of
+        // `parts` (a range of ast), in order, and returns where each one goes
+        template <typename Parts>
+        std::vector<placement> reserve(const Parts &parts)
+        {
+            std::vector<placement> at;
+            std::size_t size = used;
+            std::size_t text = strings.size();
+            for (const ast &part : parts)
+            {
+                at.push_back({static_cast<node_id>(size / unit), static_cast<std::uint32_t>(text)});
+                size += part.used;
+                text += part.strings.size();
+                count += part.count;
+            }
+            if (size > capacity)
+                grow(size);
+            if (text > std::numeric_limits<std::uint32_t>::max())
+                throw exception("AST string pool exhausted");
+            used = size;
+            strings.resize(text);
+            return at;
+        }
+        // copies `part` to where reserve() put it, moving its ids and string
+        // references along. distinct parts can be placed concurrently
+        void place(const ast &part, placement where)
+        {
+            if (part.used != 0)
+                std::memcpy(buffer + std::size_t(where.node) * unit, part.buffer, part.used);
+            part.strings.copy(strings.data() + where.text, part.strings.size());
+            relocate(where.node, static_cast<node_id>(where.node + part.used / unit), where);
+        }
+        // appends the nodes [first, last) of `from` and the strings `text` they
+        // use, which must not refer to anything outside, with their spans moved
+        // by `source`. returns the id the first node got
+        node_id copy(const ast &from, node_id first, node_id last, text_ref text, std::int64_t source)
+        {
+            auto size = std::size_t(last - first) * unit;
+            if (used + size > capacity)
+                grow(used + size);
+            placement where{static_cast<node_id>(used / unit - first), static_cast<std::uint32_t>(strings.size() - text.offset),
+                            static_cast<std::uint32_t>(source)};
+            std::memcpy(buffer + used, from.buffer + std::size_t(first) * unit, size);
+            strings.append(from.text(text));
+            auto id = static_cast<node_id>(used / unit);
+            used += size;
+            count += relocate(id, static_cast<node_id>(used / unit), where);
+            return id;
+        }
+        // the id the next node gets and the offset its strings get
+        node_id next_node() const
+        {
+            return static_cast<node_id>(used / unit);
+        }
+        std::uint32_t next_text() const
+        {
+            return static_cast<std::uint32_t>(strings.size());
+        }
+
+        // the nodes and the string pool as they are laid out, for writing the
+        // tree out in a form adopt() can use as is
+        std::span<const std::byte> node_bytes() const
+        {
+            return std::span<const std::byte>(buffer, used);
+        }
+        std::string_view string_pool() const
+        {
+            return strings;
+        }
+        // uses `nodes`, the node_bytes() of a tree written out earlier holding
+        // `nodes_count` nodes, in place of an arena of its own. `owner` keeps
+        // them alive and they must be 8-byte aligned and writable (a resolver
+        // annotates nodes). the first make() moves them into an arena
+        void adopt(std::span<std::byte> nodes, std::size_t nodes_count, std::string_view pool, std::shared_ptr<void> owner)
+        {
+            if (nodes.size() % unit != 0 || reinterpret_cast<std::uintptr_t>(nodes.data()) % unit != 0)
+                throw exception("Misaligned AST nodes");
+            release();
+            buffer = nodes.data();
+            used = capacity = nodes.size();
+            count = nodes_count;
+            strings.assign(pool);
+            borrowed = std::move(owner);
+        }
+        // whether the arena holds a tree the passes can walk without reading
+        // outside it or going round in circles, for nodes that came from a
+        // file and may be anything: every node of a known kind and inside the
+        // arena, its children made before it (as the parser makes them) and
+        // under no other node, its strings inside the pool, its names below
+        // `names`, its span inside a source of `source` bytes and no more than
+        // `depth` levels under it
+        bool well_formed(std::size_t names, std::size_t source, std::size_t depth) const
+        {
+            auto end = used / unit;
+            // levels of the node starting at each unit, 0 where none starts
+            std::vector<std::uint16_t> levels(end);
+            // nodes that are some node's child already, a second parent would
+            // let the resolver annotate one var node for two scopes
+            std::vector<bool> taken(end);
+            std::size_t nodes = 0;
+            depth = std::min<std::size_t>(depth, std::numeric_limits<std::uint16_t>::max() - 1);
+            for (std::size_t id = 0; id < end; nodes++)
+            {
+                if (end - id < units<node>(0) || std::to_underlying(kind(static_cast<node_id>(id))) > std::to_underlying(node_kind::prog_t))
+                    return false;
+                auto &n = at(static_cast<node_id>(id));
+                auto size = size_of(n);
+                if (end - id < size || n.span.begin > n.span.end || n.span.end > source)
+                    return false;
+                std::size_t below = 0;
+                auto child = [&](node_id c, bool optional = false)
+                {
+                    if (c == no_node)
+                        return optional;
+                    if (c >= id || levels[c] == 0 || taken[c])
+                        return false;
+                    taken[c] = true;
+                    below = std::max<std::size_t>(below, levels[c]);
+                    return true;
+                };
+                auto var = [&](node_id c)
+                {
+                    return child(c) && kind(c) == node_kind::var_t;
+                };
+                auto id32 = static_cast<node_id>(id);
+                bool ok = true;
+                switch (n.kind)
+                {
+                case node_kind::num_t:
+                    break;
+                case node_kind::str_t:
+                {
+                    auto ref = get<str_node>(id32).value;
+                    ok = std::size_t(ref.offset) + ref.length <= strings.size();
+                    break;
+                }
+                case node_kind::bool_t:
+                    ok = reinterpret_cast<const unsigned char &>(get<bool_node>(id32).value) <= 1;
+                    break;
+                case node_kind::var_t:
+                    ok = get<var_node>(id32).name < names;
+                    break;
+                case node_kind::assign_t:
+                case node_kind::binary_t:
+                {
+                    auto &b = get<binary_node>(id32);
+                    ok = n.op < operators.size() && (n.kind == node_kind::assign_t ? var(b.left) : child(b.left)) && child(b.right);
+                    break;
+                }
+                case node_kind::call_t:
+                    ok = child(get<call_node>(id32).func);
+                    for (auto arg : children<call_node>(id32))
+                        ok = ok && child(arg);
+                    break;
+                case node_kind::if_t:
+                {
+                    auto &i = get<if_node>(id32);
+                    ok = child(i.cond) && child(i.then) && child(i.else_, true);
+                    break;
+                }
+                case node_kind::lambda_t:
+                    ok = child(get<lambda_node>(id32).body);
+                    for (auto v : children<lambda_node>(id32))
+                        ok = ok && var(v);
+                    break;
+                case node_kind::prog_t:
+                    for (auto item : children<prog_node>(id32))
+                        ok = ok && child(item);
+                    break;
+                }
+                if (!ok || below >= depth)
+                    return false;
+                levels[id] = static_cast<std::uint16_t>(below + 1);
+                id += size;
+            }
+            return nodes == count && (root == no_node || (root < end && levels[root] != 0 && !taken[root]));
+        }
+
+        std::size_t bytes() const
+        {
+            return used + strings.size();
+        }
+        std::pmr::memory_resource *resource() const
+        {
+            return memory;
+        }
+        // nodes allocated so far, reachable or not
+        std::size_t nodes() const
+        {
+            return count;
+        }
+
+        void dump(std::ostream &os, node_id id) const
+        {
+            if (id == no_node)
+            {
+                os << "()";
+                return;
+            }
+            switch (kind(id))
+            {
+            case node_kind::num_t:
+                os << get<num_node>(id).value;
+                return;
+            case node_kind::str_t:
+                os << '"' << text(get<str_node>(id).value) << '"';
+                return;
+            case node_kind::bool_t:
+                os << (get<bool_node>(id).value ? "true" : "false");
+                return;
+            case node_kind::var_t:
+                os << symbols->name(get<var_node>(id).name);
+                return;
+            case node_kind::assign_t:
+            case node_kind::binary_t:
+            {
+                auto &n = get<binary_node>(id);
+                os << '(' << to_string(static_cast<op_kind>(n.head.op)) << ' ';
+                dump(os, n.left);
+                os << ' ';
+                dump(os, n.right);
+                os << ')';
+                return;
+            }
+            case node_kind::call_t:
+                os << "(call ";
+                dump(os, get<call_node>(id).func);
+                for (auto arg : children<call_node>(id))
+                {
+                    os << ' ';
+                    dump(os, arg);
+                }
+                os << ')';
+                return;
+            case node_kind::if_t:
+            {
+                auto &n = get<if_node>(id);
+                os << "(if ";
+                dump(os, n.cond);
+                os << ' ';
+                dump(os, n.then);
+                os << ' ';
+                dump(os, n.else_);
+                os << ')';
+                return;
+            }
+            case node_kind::lambda_t:
+                os << "(lambda (";
+                for (auto var : children<lambda_node>(id))
+                {
+                    dump(os, var);
+                    os << ' ';
+                }
+                os << ") ";
+                dump(os, get<lambda_node>(id).body);
+                os << ')';
+                return;
+            case node_kind::prog_t:
+                os << "(prog";
+                for (auto item : children<prog_node>(id))
+                {
+                    os << ' ';
+                    dump(os, item);
+                }
+                os << ')';
+                return;
+            }
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.mapped_file.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.symbol_table.hpp"
+
+namespace ccpp
+{
+    // 64-bit hash of a source, 8 bytes at a time. identifies the source a
+    // cached tree was parsed from, it is no defence against tampering
+    inline std::uint64_t source_hash(std::string_view text)
+    {
+        constexpr std::uint64_t mul = 0x9e3779b97f4a7c15ull;
+        auto mix = [](std::uint64_t h)
+        {
+            h ^= h >> 32;
+            h *= 0xd6e8feb86659fd93ull;
+            return h ^ (h >> 32);
+        };
+        std::uint64_t h = text.size() * mul;
+        std::size_t i = 0;
+        for (; i + 8 <= text.size(); i += 8)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, text.data() + i, 8);
+            h = (h ^ mix(word)) * mul;
+        }
+        std::uint64_t tail = 0;
+        if (i < text.size())
+            std::memcpy(&tail, text.data() + i, text.size() - i);
+        return mix((h ^ mix(tail)) * mul);
+    }
+
+    // the parser's output for a script written out as a `.ccppc` file next to
+    // it, laid out so that a mapping of the file is the tree:
+    //
+    //   header | nodes | string pool | name lengths | names
+    //
+    // the nodes are the arena as it was, ids are already offsets from its
+    // start, and var nodes name symbols by id, which come back the same when
+    // the names are interned in order. loading maps the file copy-on-write and
+    // adopts the nodes in place, only the string pool and the names are
+    // copied. the header records the hash and size of the source, a format
+    // version and the node layout; a file that doesn't match them, or whose
+    // nodes don't hold together as a tree, is parsed again and rewritten, so a
+    // changed script never runs from a stale tree nor a damaged file from a
+    // broken one
+    class ast_cache
+    {
+        struct header
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint64_t layout;
+            std::uint64_t hash;
+            std::uint64_t size;
+            std::uint64_t node_bytes;
+            std::uint64_t nodes;
+            std::uint64_t text_bytes;
+            std::uint64_t names;
+            std::uint64_t name_bytes;
+            std::uint32_t root;
+            std::uint32_t reserved = 0;
+        };
+        // "CPPC" read as a little-endian word, a big-endian reader sees it
+        // reversed and treats the file as a miss
+        static constexpr std::uint32_t magic = 0x43505043;
+        // sizes of the node structs, a change to any of them is a new format
+        static constexpr std::uint64_t layout = sizeof(node) | sizeof(num_node) << 8 | sizeof(str_node) << 16 | sizeof(bool_node) << 24 |
+                                                std::uint64_t(sizeof(var_node)) << 32 | std::uint64_t(sizeof(binary_node)) << 40 |
+                                                std::uint64_t(sizeof(call_node) + sizeof(if_node)) << 48 |
+                                                std::uint64_t(sizeof(lambda_node) + sizeof(prog_node)) << 56;
+
+        static std::size_t align(std::size_t offset)
+        {
+            return (offset + 7) & ~std::size_t(7);
+        }
+
+    public:
+        // bump when the encoding changes in a way the layout doesn't show
+        static constexpr std::uint32_t version = 1;
+        // deeper trees in a file are taken as corrupt. the parser's nesting
+        // limit keeps the trees it makes within about half of this
+        static constexpr std::size_t max_depth = 1 << 14;
+
+        // where the tree of `script` is cached
+        static std::filesystem::path path_for(const std::filesystem::path &script)
+        {
+            auto file = script;
+            return file.replace_extension(".ccppc");
+        }
+
+        // the tree in `file` if it was written for a source with this hash
+        // and size, else false. a missing, stale, truncated or corrupt file
+        // is a miss
+        static bool load(const std::filesystem::path &file, std::uint64_t hash, std::size_t size, ccpp::ast &tree)
+        {
+            std::error_code error;
+            if (!std::filesystem::is_regular_file(file, error))
+                return false;
+            std::shared_ptr<ccpp::mapped_file> mapped;
+            try
+            {
+                mapped = std::make_shared<ccpp::mapped_file>(file, true);
+            }
+            catch (const exception &)
+            {
+                return false;
+            }
+            auto total = mapped->size();
+            header h;
+            if (total < sizeof(h))
+                return false;
+            std::memcpy(&h, mapped->data(), sizeof(h));
+            if (h.magic != magic || h.version != version || h.layout != layout || h.hash != hash || h.size != size)
+                return false;
+            auto nodes_at = align(sizeof(h));
+            auto text_at = nodes_at + h.node_bytes;
+            auto lengths_at = text_at + h.text_bytes;
+            auto names_at = lengths_at + h.names * sizeof(std::uint32_t);
+            if (h.node_bytes > total || h.node_bytes % 8 != 0 || h.text_bytes > total || h.names > total || h.name_bytes > total ||
+                names_at + h.name_bytes != total || (h.root != no_node && h.root >= h.node_bytes / 8))
+                return false;
+
+            auto symbols = std::make_shared<ccpp::symbol_table>();
+            auto name = mapped->data() + names_at;
+            for (std::size_t i = 0; i < h.names; i++)
+            {
+                std::uint32_t length;
+                std::memcpy(&length, mapped->data() + lengths_at + i * sizeof(length), sizeof(length));
+                if (length > static_cast<std::size_t>(mapped->data() + total - name) || symbols->intern(std::string_view(name, length)) != i)
+                    return false;
+                name += length;
+            }
+
+            // the header only says the file was written for this source, the
+            // nodes are checked before anything walks them
+            ccpp::ast loaded;
+            loaded.adopt(std::span<std::byte>(reinterpret_cast<std::byte *>(mapped->writable_data() + nodes_at), h.node_bytes), h.nodes,
+                         std::string_view(mapped->data() + text_at, h.text_bytes), mapped);
+            loaded.root = h.root;
+            if (!loaded.well_formed(h.names, size, max_depth))
+                return false;
+            loaded.symbols = std::move(symbols);
+            tree = std::move(loaded);
+            return true;
+        }
+
+        // writes `tree`, parsed from a source with this hash and size. the
+        // file is replaced in one rename, so readers never see half of it
+        static void store(const std::filesystem::path &file, const ccpp::ast &tree, std::uint64_t hash, std::size_t size)
+        {
+            auto nodes = tree.node_bytes();
+            auto pool = tree.string_pool();
+            header h{};
+            h.magic = magic;
+            h.version = version;
+            h.layout = layout;
+            h.hash = hash;
+            h.size = size;
+            h.node_bytes = nodes.size();
+            h.nodes = tree.nodes();
+            h.text_bytes = pool.size();
+            h.names = tree.symbols->size();
+            h.root = tree.root;
+            std::vector<std::uint32_t> lengths(h.names);
+            for (std::size_t i = 0; i < h.names; i++)
+            {
+                lengths[i] = static_cast<std::uint32_t>(tree.symbols->name(static_cast<symbol>(i)).size());
+                h.name_bytes += lengths[i];
+            }
+
+            // a name of its own, processes may store the same script at once
+            auto temp = file;
+            temp += "." + std::to_string(std::random_device()()) + ".tmp";
+            {
+                std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+                if (!out)
+                    throw exception("Can't write " + temp.string());
+                const char padding[8] = {};
+                out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+                out.write(padding, static_cast<std::streamsize>(align(sizeof(h)) - sizeof(h)));
+                out.write(reinterpret_cast<const char *>(nodes.data()), static_cast<std::streamsize>(nodes.size()));
+                out.write(pool.data(), static_cast<std::streamsize>(pool.size()));
+                out.write(reinterpret_cast<const char *>(lengths.data()), static_cast<std::streamsize>(lengths.size() * sizeof(std::uint32_t)));
+                for (std::size_t i = 0; i < h.names; i++)
+                {
+                    auto name = tree.symbols->name(static_cast<symbol>(i));
+                    out.write(name.data(), static_cast<std::streamsize>(name.size()));
+                }
+                if (!out.flush())
+                    throw exception("Can't write " + temp.string());
+            }
+            std::error_code error;
+            std::filesystem::rename(temp, file, error);
+            if (error)
+            {
+                std::filesystem::remove(temp, error);
+                throw exception("Can't write " + file.string());
+            }
+        }
+
+        // the tree of `script`, from its cache file when that was written
+        // for the same source, else parsed and written to the cache. failing
+        // to write the cache (a read-only directory) only costs the next start
+        static ccpp::ast parse(const std::filesystem::path &script)
+        {
+            ccpp::input_stream is{ccpp::mapped_file(script)};
+            auto source = is.source();
+            auto hash = source_hash(source);
+            auto file = path_for(script);
+            ccpp::ast tree;
+            if (load(file, hash, source.size(), tree))
+                return tree;
+            tree = ccpp::parser{ccpp::token_stream(is)}.parse();
+            try
+            {
+                store(file, tree, hash, source.size());
+            }
+            catch (const exception &)
+            {
+            }
+            return tree;
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ccpp
+{
+    // timing harness for ccpp.bench: a benchmark runs a few times untimed to
+    // warm caches and the allocator, then `runs` times timed, and reports the
+    // cold run, median and p99 with the rate of its unit of work
+    namespace bench
+    {
+        struct result
+        {
+            std::string name;
+            // what `work` counts: bytes, nodes or calls
+            std::string unit;
+            double work = 0;
+            std::size_t warmup = 0;
+            std::size_t runs = 0;
+            // the first warm-up run, before anything was cached
+            double cold_ms = 0;
+            double min_ms = 0;
+            double median_ms = 0;
+            double p99_ms = 0;
+            // work per second at the median
+            double rate = 0;
+            // other numbers about the benchmark, such as allocations per call
+            std::vector<std::pair<std::string, double>> metrics{};
+        };
+
+        class harness
+        {
+            std::vector<result> results;
+
+            static double elapsed_ms(std::chrono::steady_clock::time_point from)
+            {
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+            }
+            // nearest rank, so with few runs p99 is the slowest of them
+            static double percentile(const std::vector<double> &sorted, double p)
+            {
+                auto rank = static_cast<std::size_t>(std::ceil(p / 100 * static_cast<double>(sorted.size())));
+                return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+            }
+            static void write_string(std::ostream &os, std::string_view text)
+            {
+                os << '"';
+                for (char ch : text)
+                {
+                    if (ch == '"' || ch == '\\')
+                        os << '\\' << ch;
+                    else if (static_cast<unsigned char>(ch) < 0x20)
+                    {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                        os << escaped;
+                    }
+                    else
+                        os << ch;
+                }
+                os << '"';
+            }
+
+        public:
+            std::size_t warmup = 3;
+            std::size_t runs = 30;
+            // only benchmarks whose name contains this run
+            std::string filter;
+            // each result is printed here as it comes in, when set
+            std::ostream *progress = nullptr;
+
+            bool selected(std::string_view name) const
+            {
+                return name.find(filter) != std::string_view::npos;
+            }
+            // times `body(state)` where `state` is what `setup()` returned
+            // before that run. setup is not timed, it makes what a run uses
+            // up (an evaluator, a copy of the input) fresh each time. returns
+            // the result, or null when the filter left the benchmark out
+            template <typename Setup, typename Body>
+            result *measure(std::string name, std::string unit, double work, Setup setup, Body body)
+            {
+                if (!selected(name))
+                    return nullptr;
+                result r{std::move(name), std::move(unit), work, warmup, runs};
+                for (std::size_t i = 0; i < warmup; i++)
+                {
+                    auto state = setup();
+                    auto start = std::chrono::steady_clock::now();
+                    body(state);
+                    if (i == 0)
+                        r.cold_ms = elapsed_ms(start);
+                }
+                std::vector<double> times;
+                for (std::size_t i = 0; i < runs; i++)
+                {
+                    auto state = setup();
+                    auto start = std::chrono::steady_clock::now();
+                    body(state);
+                    times.push_back(elapsed_ms(start));
+                }
+                if (!times.empty())
+                {
+                    std::sort(times.begin(), times.end());
+                    r.min_ms = times.front();
+                    r.median_ms = percentile(times, 50);
+                    r.p99_ms = percentile(times, 99);
+                    r.rate = r.median_ms > 0 ? work / (r.median_ms / 1000) : 0;
+                }
+                if (progress != nullptr)
+                    print(*progress, r);
+                results.push_back(std::move(r));
+                return &results.back();
+            }
+            template <typename Body>
+            result *measure(std::string name, std::string unit, double work, Body body)
+            {
+                return measure(std::move(name), std::move(unit), work, []()
+                        { return 0; },
+                        [&](int)
+                        { body(); });
+            }
+            // adds a number to a result measured above
+            void annotate(result &r, std::string key, double value)
+            {
+                if (progress != nullptr)
+                {
+                    char line[128];
+                    std::snprintf(line, sizeof(line), "%-36s %s %.4g\n", "", key.c_str(), value);
+                    *progress << line;
+                }
+                r.metrics.emplace_back(std::move(key), value);
+            }
+            const std::vector<result> &all() const
+            {
+                return results;
+            }
+
+            static void print(std::ostream &os, const result &r)
+            {
+                char line[256];
+                std::snprintf(line, sizeof(line), "%-36s median %9.3fms  p99 %9.3fms  cold %9.3fms  %10.2f M%s/s\n", r.name.c_str(),
+                              r.median_ms, r.p99_ms, r.cold_ms, r.rate / 1e6, r.unit.c_str());
+                os << line;
+            }
+            // every result as one json document, `context` (pairs of names
+            // and values) is written alongside them to tell runs apart
+            void write_json(std::ostream &os, const std::vector<std::pair<std::string, std::string>> &context) const
+            {
+                os << "{\n  \"context\": {";
+                for (std::size_t i = 0; i < context.size(); i++)
+                {
+                    os << (i == 0 ? "\n    " : ",\n    ");
+                    write_string(os, context[i].first);
+                    os << ": ";
+                    write_string(os, context[i].second);
+                }
+                os << "\n  },\n  \"results\": [";
+                char number[64];
+                auto field = [&](const char *key, double value)
+                {
+                    std::snprintf(number, sizeof(number), "%.10g", value);
+                    os << ", \"" << key << "\": " << number;
+                };
+                for (std::size_t i = 0; i < results.size(); i++)
+                {
+                    auto &r = results[i];
+                    os << (i == 0 ? "\n    {" : ",\n    {") << "\"name\": ";
+                    write_string(os, r.name);
+                    os << ", \"unit\": ";
+                    write_string(os, r.unit);
+                    field("work", r.work);
+                    field("warmup", static_cast<double>(r.warmup));
+                    field("runs", static_cast<double>(r.runs));
+                    field("cold_ms", r.cold_ms);
+                    field("min_ms", r.min_ms);
+                    field("median_ms", r.median_ms);
+                    field("p99_ms", r.p99_ms);
+                    field("rate", r.rate);
+                    if (!r.metrics.empty())
+                    {
+                        os << ", \"metrics\": {";
+                        for (std::size_t m = 0; m < r.metrics.size(); m++)
+                        {
+                            os << (m == 0 ? "" : ", ");
+                            write_string(os, r.metrics[m].first);
+                            std::snprintf(number, sizeof(number), "%.10g", r.metrics[m].second);
+                            os << ": " << number;
+                        }
+                        os << "}";
+                    }
+                    os << "}";
+                }
+                os << "\n  ]\n}\n";
+            }
+        };
+    } // namespace bench
+} // namespace ccpp
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "ccpp.execption.hpp"
+#include "ccpp.operator.hpp"
+#include "ccpp.value.hpp"
+
+namespace ccpp
+{
+    inline double expect_number(const value &v)
+    {
+        if (!v.is_number())
+            throw exception("Expected number but got " + std::string(v.type_name()));
+        return v.as_number();
+    }
+
+    // integer result if it still fits in 32 bits, the double otherwise
+    inline value int_result(std::int64_t r)
+    {
+        if (r >= INT32_MIN && r <= INT32_MAX)
+            return value(static_cast<std::int32_t>(r));
+        return value(static_cast<double>(r));
+    }
+
+    // arithmetic and comparison operators, shared by every engine. assign and
+    // the short-circuiting && and || are control flow and handled by the caller.
+    // two integers take the fast path, mixed numbers go through double
+    inline value apply_op(op_kind op, const value &a, const value &b)
+    {
+        bool ints = value::both_int(a, b);
+        switch (op)
+        {
+        case op_kind::add:
+            if (ints)
+                return int_result(std::int64_t(a.as_int()) + b.as_int());
+            if (a.is_string() && b.is_string())
+                return value::string(std::string(a.as_string()) + std::string(b.as_string()));
+            return expect_number(a) + expect_number(b);
+        case op_kind::sub:
+            if (ints)
+                return int_result(std::int64_t(a.as_int()) - b.as_int());
+            return expect_number(a) - expect_number(b);
+        case op_kind::mul:
+            if (ints)
+                return int_result(std::int64_t(a.as_int()) * b.as_int());
+            return expect_number(a) * expect_number(b);
+        case op_kind::div:
+        {
+            double divisor = expect_number(b);
+            if (divisor == 0)
+                throw exception("Divide by zero");
+            return expect_number(a) / divisor;
+        }
+        case op_kind::mod:
+        {
+            double divisor = expect_number(b);
+            if (divisor == 0)
+                throw exception("Divide by zero");
+            if (ints)
+                return int_result(std::int64_t(a.as_int()) % b.as_int());
+            return std::fmod(expect_number(a), divisor);
+        }
+        case op_kind::lt:
+            if (ints)
+                return a.as_int() < b.as_int();
+            return expect_number(a) < expect_number(b);
+        case op_kind::gt:
+            if (ints)
+                return a.as_int() > b.as_int();
+            return expect_number(a) > expect_number(b);
+        case op_kind::le:
+            if (ints)
+                return a.as_int() <= b.as_int();
+            return expect_number(a) <= expect_number(b);
+        case op_kind::ge:
+            if (ints)
+                return a.as_int() >= b.as_int();
+            return expect_number(a) >= expect_number(b);
+        case op_kind::eq:
+            return a == b;
+        case op_kind::ne:
+            return !(a == b);
+        default:
+            throw exception("Can't apply operator " + std::string(to_string(op)));
+        }
+    }
+
+    // host functions every engine starts with, `define(name, value)` installs one
+    template <typename Define>
+    void define_builtins(Define define, std::ostream &out)
+    {
+        define("print", make_object<native_object>("print", [&out](std::span<const value> args)
+                                                               {
+            for (auto &arg : args)
+                out << arg.to_string();
+            return value(false); }));
+        define("println", make_object<native_object>("println", [&out](std::span<const value> args)
+                                                                 {
+            for (auto &arg : args)
+                out << arg.to_string();
+            out << '\n';
+            return value(false); }));
+    }
+} // namespace ccpp
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.value.hpp"
+
+namespace ccpp
+{
+    // every instruction is an opcode word followed by its operand words
+    enum class opcode : std::uint32_t
+    {
+        constant,      // k: push constants[k]
+        push_true,     //
+        push_false,    //
+        load_local,    // slot: push a stack slot of the current activation
+        load_up,       // depth slot: push a stack slot `depth` activations down
+        load_boxed,    // depth slot: push a slot of the heap frame `depth` frames up
+        store_local,   // slot: set a stack slot of the current activation, keeps the value
+        store_up,      // depth slot
+        store_boxed,   // depth slot
+        load_global,   // g
+        store_global,  // g
+        add,           //
+        sub,           //
+        mul,           //
+        div,           //
+        mod,           //
+        lt,            //
+        gt,            //
+        le,            //
+        ge,            //
+        eq,            //
+        ne,            //
+        jump,          // target
+        jump_if_false, // target: pops the condition
+        and_jump,      // target: pops, if falsy pushes false and jumps
+        or_jump,       // target: pops, if truthy pushes true and jumps
+        pop,           //
+        closure,       // f: push a closure of function f over the current heap frame
+        function,      // f: push the shared closure of function f, which needs no frame
+        call,          // argc: callee and args are on the stack
+        tail_call,     // argc: like call but replaces the current activation
+        return_,       //
+        count_,
+    };
+
+    inline constexpr std::uint32_t operand_count(opcode op)
+    {
+        switch (op)
+        {
+        case opcode::load_up:
+        case opcode::load_boxed:
+        case opcode::store_up:
+        case opcode::store_boxed:
+            return 2;
+        case opcode::constant:
+        case opcode::load_local:
+        case opcode::store_local:
+        case opcode::load_global:
+        case opcode::store_global:
+        case opcode::jump:
+        case opcode::jump_if_false:
+        case opcode::and_jump:
+        case opcode::or_jump:
+        case opcode::closure:
+        case opcode::function:
+        case opcode::call:
+        case opcode::tail_call:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+    inline constexpr std::string_view to_string(opcode op)
+    {
+        constexpr std::string_view names[] = {
+            "constant", "push_true", "push_false", "load_local", "load_up", "load_boxed", "store_local", "store_up",
+            "store_boxed", "load_global", "store_global", "add", "sub", "mul", "div", "mod", "lt", "gt", "le", "ge",
+            "eq", "ne", "jump", "jump_if_false", "and_jump", "or_jump", "pop", "closure", "function", "call",
+            "tail_call", "return"};
+        static_assert(std::size(names) == static_cast<std::size_t>(opcode::count_));
+        return names[static_cast<std::size_t>(op)];
+    }
+
+    // compiled body of one lambda (or of the toplevel, function 0). parameters
+    // live in stack slots, the boxed ones are copied into a heap frame on entry
+    struct function_proto
+    {
+        std::uint32_t params = 0;
+        std::vector<std::uint32_t> boxed;
+        std::vector<std::uint32_t> code;
+        std::vector<value> constants;
+    };
+
+    struct program
+    {
+        std::vector<function_proto> functions;
+
+        void disassemble(std::ostream &os) const
+        {
+            for (std::size_t f = 0; f < functions.size(); f++)
+            {
+                auto &fn = functions[f];
+                os << "function " << f << " (" << fn.params << " params";
+                if (!fn.boxed.empty())
+                    os << ", " << fn.boxed.size() << " boxed";
+                os << ")\n";
+                for (std::size_t ip = 0; ip < fn.code.size();)
+                {
+                    auto op = static_cast<opcode>(fn.code[ip]);
+                    os << "  " << ip << ": " << to_string(op);
+                    for (std::uint32_t i = 1; i <= operand_count(op); i++)
+                        os << ' ' << fn.code[ip + i];
+                    if (op == opcode::constant)
+                        os << " ; " << fn.constants[fn.code[ip + 1]].to_string();
+                    os << '\n';
+                    ip += 1 + operand_count(op);
+                }
+            }
+        }
+    };
+} // namespace ccpp
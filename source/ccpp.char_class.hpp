@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace ccpp
+{
+    // character classes used by the lexer, one table lookup per character
+    namespace char_class
+    {
+        enum : std::uint8_t
+        {
+            whitespace = 1 << 0, // " \t\n"
+            id_start = 1 << 1,   // a-z A-Z _ and any byte of a utf-8 sequence (λ)
+            id = 1 << 2,         // id_start ?!-<>= 0-9
+            op = 1 << 3,         // +-*/%=&|<>!
+            punc = 1 << 4,       // ,;(){}[]
+            digit = 1 << 5,      // 0-9
+            quote = 1 << 6,      // "
+            comment = 1 << 7,    // #
+        };
+
+        constexpr std::array<std::uint8_t, 256> make_table()
+        {
+            std::array<std::uint8_t, 256> table{};
+            auto set = [&](const char *chars, std::uint8_t flags)
+            {
+                for (; *chars != '\0'; chars++)
+                    table[static_cast<unsigned char>(*chars)] |= flags;
+            };
+            for (int ch = 'a'; ch <= 'z'; ch++)
+                table[ch] |= id_start | id;
+            for (int ch = 'A'; ch <= 'Z'; ch++)
+                table[ch] |= id_start | id;
+            for (int ch = 0x80; ch <= 0xff; ch++)
+                table[ch] |= id_start | id;
+            set("_", id_start | id);
+            set("?!-<>=", id);
+            set("0123456789", id | digit);
+            set(" \t\n", whitespace);
+            set("+-*/%=&|<>!", op);
+            set(",;(){}[]", punc);
+            set("\"", quote);
+            set("#", comment);
+            return table;
+        }
+
+        inline constexpr std::array<std::uint8_t, 256> table = make_table();
+
+        constexpr bool is(char ch, std::uint8_t flags)
+        {
+            return (table[static_cast<unsigned char>(ch)] & flags) != 0;
+        }
+    } // namespace char_class
+} // namespace ccpp
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.resolver.hpp"
+#include "ccpp.value.hpp"
+
+namespace ccpp
+{
+    // translates a resolved ast into one c++ translation unit on top of
+    // ccpp.runtime.hpp: a function per lambda, a static per global, string
+    // literals built once, and self tail calls turned into jumps
+    class codegen
+    {
+        ccpp::ast &tree;
+        // bodies of the emitted functions, fn_<index>
+        std::vector<std::string> functions;
+        std::vector<std::string> strings;
+        std::set<symbol> globals;
+        std::size_t temporaries = 0;
+        // the function being emitted has a self tail call
+        bool jumps = false;
+
+        static std::string quote(std::string_view text)
+        {
+            std::string out = "\"";
+            for (unsigned char c : text)
+            {
+                if (c == '"' || c == '\\')
+                    out += '\\', out += static_cast<char>(c);
+                else if (c == '\n')
+                    out += "\\n";
+                else if (c < 0x20 || c >= 0x7f)
+                {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\%03o", c);
+                    out += buffer;
+                }
+                else
+                    out += static_cast<char>(c);
+            }
+            return out + '"';
+        }
+        static std::string number(double d)
+        {
+            auto v = value::number(d);
+            char buffer[32];
+            if (v.is_int())
+                return "ccpp::value(std::int32_t(" + std::string(buffer, std::to_chars(buffer, buffer + sizeof(buffer), v.as_int()).ptr) + "))";
+            // folding can make these, they have no literal in c++
+            if (std::isnan(d))
+                return "ccpp::value(std::numeric_limits<double>::quiet_NaN())";
+            if (std::isinf(d))
+                return d < 0 ? "ccpp::value(-std::numeric_limits<double>::infinity())" : "ccpp::value(std::numeric_limits<double>::infinity())";
+            std::string text(buffer, std::to_chars(buffer, buffer + sizeof(buffer), d).ptr);
+            if (text.find_first_of(".e") == std::string::npos)
+                text += ".0";
+            return "ccpp::value(" + text + ")";
+        }
+        static std::string_view op_name(op_kind op)
+        {
+            switch (op)
+            {
+            case op_kind::add:
+                return "add";
+            case op_kind::sub:
+                return "sub";
+            case op_kind::mul:
+                return "mul";
+            case op_kind::div:
+                return "div";
+            case op_kind::mod:
+                return "mod";
+            case op_kind::lt:
+                return "lt";
+            case op_kind::gt:
+                return "gt";
+            case op_kind::le:
+                return "le";
+            case op_kind::ge:
+                return "ge";
+            case op_kind::eq:
+                return "eq";
+            case op_kind::ne:
+                return "ne";
+            default:
+                throw exception("Can't generate operator " + std::string(to_string(op)));
+            }
+        }
+
+        std::string slot(const var_node &var)
+        {
+            if (static_cast<var_scope>(var.head.op) == var_scope::global)
+            {
+                globals.insert(var.name);
+                return "g_" + std::to_string(var.name);
+            }
+            if (var.head.flags == 0)
+                return "env->slots[" + std::to_string(var.head.count) + "]";
+            return "rt::up(env.get(), " + std::to_string(var.head.flags) + ")->slots[" + std::to_string(var.head.count) + "]";
+        }
+
+        // a c++ expression of type ccpp::value
+        std::string expression(node_id id)
+        {
+            switch (tree.kind(id))
+            {
+            case node_kind::num_t:
+                return number(tree.get<num_node>(id).value);
+            case node_kind::str_t:
+                strings.emplace_back(tree.text(tree.get<str_node>(id).value));
+                return "s_" + std::to_string(strings.size() - 1);
+            case node_kind::bool_t:
+                return tree.get<bool_node>(id).value ? "ccpp::value(true)" : "ccpp::value(false)";
+            case node_kind::var_t:
+            {
+                auto &var = tree.get<var_node>(id);
+                if (static_cast<var_scope>(var.head.op) == var_scope::global)
+                    return "rt::read(" + slot(var) + ", " + quote(tree.symbols->name(var.name)) + ")";
+                return slot(var);
+            }
+            case node_kind::assign_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                return "(" + slot(tree.get<var_node>(n.left)) + " = " + expression(n.right) + ")";
+            }
+            case node_kind::binary_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                auto op = static_cast<op_kind>(n.head.op);
+                if (op == op_kind::and_)
+                    return "(rt::truthy(" + expression(n.left) + ") ? ccpp::value(" + expression(n.right) + ") : ccpp::value(false))";
+                if (op == op_kind::or_)
+                    return "(rt::truthy(" + expression(n.left) + ") ? ccpp::value(true) : ccpp::value(" + expression(n.right) + "))";
+                return "rt::binary<ccpp::op_kind::" + std::string(op_name(op)) + ">({" + expression(n.left) + ", " + expression(n.right) + "})";
+            }
+            case node_kind::call_t:
+            {
+                std::string out = "rt::call({" + expression(tree.get<call_node>(id).func);
+                for (auto arg : tree.children<call_node>(id))
+                    out += ", " + expression(arg);
+                return out + "})";
+            }
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                auto otherwise = n.else_ != no_node ? expression(n.else_) : "ccpp::value(false)";
+                return "(rt::truthy(" + expression(n.cond) + ") ? ccpp::value(" + expression(n.then) + ") : ccpp::value(" + otherwise + "))";
+            }
+            case node_kind::lambda_t:
+                return "rt::make_closure(&fn_" + std::to_string(function(id)) + ", " + std::to_string(tree.get<lambda_node>(id).head.count) + ", env)";
+            case node_kind::prog_t:
+            {
+                auto items = tree.children<prog_node>(id);
+                std::string out = "(";
+                for (std::size_t i = 0; i + 1 < items.size(); i++)
+                    out += "void(" + expression(items[i]) + "), ";
+                return out + "ccpp::value(" + expression(items.back()) + "))";
+            }
+            }
+            throw exception("Can't generate " + std::string(to_string(tree.kind(id))));
+        }
+
+        // statements returning the value of `id` from function `fn`
+        void tail(std::ostream &os, node_id id, std::size_t fn, const std::string &indent)
+        {
+            switch (tree.kind(id))
+            {
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                os << indent << "if (rt::truthy(" << expression(n.cond) << "))\n"
+                   << indent << "{\n";
+                tail(os, n.then, fn, indent + "    ");
+                os << indent << "}\n";
+                if (n.else_ != no_node)
+                    tail(os, n.else_, fn, indent);
+                else
+                    os << indent << "return ccpp::value(false);\n";
+                return;
+            }
+            case node_kind::prog_t:
+            {
+                auto items = tree.children<prog_node>(id);
+                for (std::size_t i = 0; i + 1 < items.size(); i++)
+                    os << indent << expression(items[i]) << ";\n";
+                tail(os, items.back(), fn, indent);
+                return;
+            }
+            case node_kind::call_t:
+            {
+                auto args = tree.children<call_node>(id);
+                auto name = "c" + std::to_string(temporaries++);
+                jumps = true;
+                os << indent << "{\n"
+                   << indent << "    ccpp::value " << name << "[] = {" << expression(tree.get<call_node>(id).func);
+                for (auto arg : args)
+                    os << ", " << expression(arg);
+                os << "};\n"
+                   << indent << "    if (auto target = rt::runs(" << name << "[0], &fn_" << fn << "))\n"
+                   << indent << "    {\n"
+                   << indent << "        env = rt::enter(*target, std::span<const ccpp::value>(" << name << " + 1, " << args.size() << "));\n"
+                   << indent << "        goto entry;\n"
+                   << indent << "    }\n"
+                   << indent << "    return rt::call(" << name << ");\n"
+                   << indent << "}\n";
+                return;
+            }
+            default:
+                os << indent << "return " << expression(id) << ";\n";
+                return;
+            }
+        }
+        // emits the function for a lambda node, returns its index
+        std::size_t function(node_id id)
+        {
+            auto index = functions.size();
+            functions.emplace_back();
+            auto outer = std::exchange(jumps, false);
+            std::ostringstream body;
+            tail(body, tree.get<lambda_node>(id).body, index, "    ");
+            std::ostringstream os;
+            os << "ccpp::value fn_" << index << "(const rt::closure &self, std::span<const ccpp::value> args)\n"
+               << "{\n"
+               << "    auto env = rt::enter(self, args);\n"
+               << (jumps ? "entry:\n" : "")
+               << body.str()
+               << "}\n";
+            functions[index] = os.str();
+            jumps = outer;
+            return index;
+        }
+
+    public:
+        codegen(ccpp::ast &tree) : tree(tree) {}
+        void generate(std::ostream &os)
+        {
+            resolver(tree).resolve();
+            functions.clear();
+            strings.clear();
+            globals.clear();
+            temporaries = 0;
+
+            std::ostringstream toplevel;
+            auto items = tree.kind(tree.root) == node_kind::prog_t ? tree.children<prog_node>(tree.root) : std::span<node_id>(&tree.root, 1);
+            for (auto item : items)
+                toplevel << "        " << expression(item) << ";\n";
+
+            os << "// generated by ccpp.compile\n"
+               << "#include \"ccpp.runtime.hpp\"\n\n"
+               << "namespace rt = ccpp::runtime;\n\n"
+               << "namespace\n"
+               << "{\n";
+            for (auto name : globals)
+                os << "ccpp::value g_" << name << "; // " << tree.symbols->name(name) << '\n';
+            for (std::size_t i = 0; i < strings.size(); i++)
+                os << "const ccpp::value s_" << i << " = ccpp::value::string(std::string(" << quote(strings[i]) << ", " << strings[i].size() << "));\n";
+            for (std::size_t i = 0; i < functions.size(); i++)
+                os << "ccpp::value fn_" << i << "(const rt::closure &self, std::span<const ccpp::value> args);\n";
+            for (auto &fn : functions)
+                os << '\n'
+                   << fn;
+            os << "} // namespace\n\n"
+               << "int main()\n"
+               << "{\n";
+            for (auto name : globals)
+                os << "    g_" << name << " = rt::builtin(" << quote(tree.symbols->name(name)) << ");\n";
+            os << "    std::shared_ptr<rt::frame> env;\n"
+               << "    try\n"
+               << "    {\n"
+               << toplevel.str()
+               << "    }\n"
+               << "    catch (const std::exception &e)\n"
+               << "    {\n"
+               << "        std::cerr << e.what() << std::endl;\n"
+               << "        return 1;\n"
+               << "    }\n"
+               << "    return 0;\n"
+               << "}\n";
+        }
+    };
+} // namespace ccpp
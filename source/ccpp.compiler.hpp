@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.bytecode.hpp"
+#include "ccpp.escape.hpp"
+#include "ccpp.resolver.hpp"
+
+namespace ccpp
+{
+    // compiles a resolved ast into bytecode, function 0 is the toplevel.
+    // escape_analysis decides which parameters are boxed and which lambdas
+    // can share one frameless closure
+    class compiler
+    {
+        ccpp::ast &tree;
+        ccpp::program prog;
+        std::size_t current = 0;
+        std::unordered_map<node_id, lambda_info> lambdas;
+        // enclosing lambdas, innermost last
+        std::vector<node_id> scopes;
+
+        std::vector<std::uint32_t> &code()
+        {
+            return prog.functions[current].code;
+        }
+        void emit(opcode op)
+        {
+            code().push_back(static_cast<std::uint32_t>(op));
+        }
+        void emit(opcode op, std::uint32_t a)
+        {
+            emit(op);
+            code().push_back(a);
+        }
+        void emit(opcode op, std::uint32_t a, std::uint32_t b)
+        {
+            emit(op, a);
+            code().push_back(b);
+        }
+        // emits a jump and returns where its target goes
+        std::size_t emit_jump(opcode op)
+        {
+            emit(op, 0);
+            return code().size() - 1;
+        }
+        void patch(std::size_t at)
+        {
+            code()[at] = static_cast<std::uint32_t>(code().size());
+        }
+        std::uint32_t add_constant(value v)
+        {
+            auto &constants = prog.functions[current].constants;
+            constants.push_back(std::move(v));
+            return static_cast<std::uint32_t>(constants.size() - 1);
+        }
+        static opcode binary_opcode(op_kind op)
+        {
+            switch (op)
+            {
+            case op_kind::add:
+                return opcode::add;
+            case op_kind::sub:
+                return opcode::sub;
+            case op_kind::mul:
+                return opcode::mul;
+            case op_kind::div:
+                return opcode::div;
+            case op_kind::mod:
+                return opcode::mod;
+            case op_kind::lt:
+                return opcode::lt;
+            case op_kind::gt:
+                return opcode::gt;
+            case op_kind::le:
+                return opcode::le;
+            case op_kind::ge:
+                return opcode::ge;
+            case op_kind::eq:
+                return opcode::eq;
+            case op_kind::ne:
+                return opcode::ne;
+            default:
+                throw exception("Can't compile operator " + std::string(to_string(op)));
+            }
+        }
+        // a boxed variable is as many heap frames up as there are lambdas
+        // with a heap frame between its owner and the current one
+        void access(const var_node &var, opcode global, opcode local, opcode up, opcode boxed)
+        {
+            if (static_cast<var_scope>(var.head.op) == var_scope::global)
+            {
+                emit(global, var.head.count);
+                return;
+            }
+            auto depth = var.head.flags;
+            auto &owner = lambdas[scopes[scopes.size() - 1 - depth]];
+            auto box = owner.box[var.head.count];
+            if (box == lambda_info::no_box)
+            {
+                if (depth == 0)
+                    emit(local, var.head.count);
+                else
+                    emit(up, depth, var.head.count);
+                return;
+            }
+            std::uint32_t frames = 0;
+            for (std::size_t i = scopes.size() - depth; i < scopes.size(); i++)
+                frames += !lambdas[scopes[i]].boxed.empty();
+            emit(boxed, frames, box);
+        }
+        void load(const var_node &var)
+        {
+            access(var, opcode::load_global, opcode::load_local, opcode::load_up, opcode::load_boxed);
+        }
+        void store(const var_node &var)
+        {
+            access(var, opcode::store_global, opcode::store_local, opcode::store_up, opcode::store_boxed);
+        }
+
+        // `tail` is set when the value of the node is returned by the function
+        void compile(node_id id, bool tail)
+        {
+            switch (tree.kind(id))
+            {
+            case node_kind::num_t:
+                emit(opcode::constant, add_constant(value::number(tree.get<num_node>(id).value)));
+                return;
+            case node_kind::str_t:
+                emit(opcode::constant, add_constant(value::string(std::string(tree.text(tree.get<str_node>(id).value)))));
+                return;
+            case node_kind::bool_t:
+                emit(tree.get<bool_node>(id).value ? opcode::push_true : opcode::push_false);
+                return;
+            case node_kind::var_t:
+                load(tree.get<var_node>(id));
+                return;
+            case node_kind::assign_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                compile(n.right, false);
+                store(tree.get<var_node>(n.left));
+                return;
+            }
+            case node_kind::binary_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                auto op = static_cast<op_kind>(n.head.op);
+                compile(n.left, false);
+                if (op == op_kind::and_ || op == op_kind::or_)
+                {
+                    auto end = emit_jump(op == op_kind::and_ ? opcode::and_jump : opcode::or_jump);
+                    compile(n.right, tail);
+                    patch(end);
+                    return;
+                }
+                compile(n.right, false);
+                emit(binary_opcode(op));
+                return;
+            }
+            case node_kind::call_t:
+            {
+                auto func = tree.get<call_node>(id).func;
+                compile(func, false);
+                auto args = tree.children<call_node>(id);
+                for (auto arg : args)
+                    compile(arg, false);
+                // a non-escaping lambda reads this activation's slots, it can't replace it
+                if (tree.kind(func) == node_kind::lambda_t && !lambdas[func].escapes)
+                    tail = false;
+                emit(tail ? opcode::tail_call : opcode::call, static_cast<std::uint32_t>(args.size()));
+                return;
+            }
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                compile(n.cond, false);
+                auto otherwise = emit_jump(opcode::jump_if_false);
+                compile(n.then, tail);
+                auto end = emit_jump(opcode::jump);
+                patch(otherwise);
+                if (n.else_ != no_node)
+                    compile(n.else_, tail);
+                else
+                    emit(opcode::push_false);
+                patch(end);
+                return;
+            }
+            case node_kind::lambda_t:
+            {
+                auto &info = lambdas[id];
+                auto parent = current;
+                current = prog.functions.size();
+                prog.functions.emplace_back();
+                prog.functions[current].params = tree.get<lambda_node>(id).head.count;
+                prog.functions[current].boxed = info.boxed;
+                scopes.push_back(id);
+                compile(tree.get<lambda_node>(id).body, true);
+                scopes.pop_back();
+                emit(opcode::return_);
+                auto index = static_cast<std::uint32_t>(current);
+                current = parent;
+                emit(info.needs_env ? opcode::closure : opcode::function, index);
+                return;
+            }
+            case node_kind::prog_t:
+            {
+                auto items = tree.children<prog_node>(id);
+                if (items.empty())
+                    emit(opcode::push_false);
+                for (std::size_t i = 0; i < items.size(); i++)
+                {
+                    if (i != 0)
+                        emit(opcode::pop);
+                    compile(items[i], tail && i + 1 == items.size());
+                }
+                return;
+            }
+            }
+        }
+
+    public:
+        compiler(ccpp::ast &tree) : tree(tree) {}
+        ccpp::program compile()
+        {
+            resolver(tree).resolve();
+            lambdas = escape_analysis(tree).analyze();
+            scopes.clear();
+            prog = ccpp::program();
+            prog.functions.emplace_back();
+            current = 0;
+            compile(tree.root, false);
+            emit(opcode::return_);
+            return std::move(prog);
+        }
+    };
+} // namespace ccpp
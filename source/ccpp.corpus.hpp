@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ccpp
+{
+    // synthetic scripts for the benchmarks, each shaped to stress one part of
+    // the front end. a generator writes statements until the script is about
+    // `bytes` long, and the same seed always gives the same script
+    namespace corpus
+    {
+        namespace detail
+        {
+            inline std::string_view pick(std::mt19937 &rng, std::initializer_list<std::string_view> words)
+            {
+                return words.begin()[rng() % words.size()];
+            }
+            inline std::string_view word(std::mt19937 &rng)
+            {
+                return pick(rng, {"alpha", "beta", "gamma", "delta", "count", "total", "index", "value", "next", "list", "is-empty?", "make!"});
+            }
+            inline std::string name(std::mt19937 &rng)
+            {
+                return std::string(word(rng)) + std::to_string(rng() % 100);
+            }
+            inline std::string_view binary_op(std::mt19937 &rng)
+            {
+                return pick(rng, {"+", "-", "*", "/", "%", "<", "<=", ">", ">=", "==", "!=", "&&", "||"});
+            }
+        } // namespace detail
+
+        // expressions nested `depth` levels deep in parens, blocks, calls,
+        // ifs and lambdas, which is the parser's recursion at its deepest
+        inline std::string deep_nesting(std::size_t bytes, std::uint32_t seed = 1, int depth = 256)
+        {
+            std::mt19937 rng(seed);
+            std::string out;
+            std::vector<std::string> closers;
+            for (std::size_t i = 0; out.size() < bytes; i++)
+            {
+                out += "nest" + std::to_string(i) + " = ";
+                for (int level = 0; level < depth; level++)
+                {
+                    switch (rng() % 5)
+                    {
+                    case 0:
+                        out += "(";
+                        closers.push_back(")");
+                        break;
+                    case 1:
+                        out += "{ " + detail::name(rng) + "; ";
+                        closers.push_back(" }");
+                        break;
+                    case 2:
+                        out += std::string(detail::word(rng)) + "(1, ";
+                        closers.push_back(")");
+                        break;
+                    case 3:
+                        out += "if " + detail::name(rng) + " then ";
+                        closers.push_back(" else 0");
+                        break;
+                    default:
+                        out += "lambda(" + detail::name(rng) + ") ";
+                        closers.push_back("");
+                        break;
+                    }
+                }
+                out += detail::name(rng);
+                for (; !closers.empty(); closers.pop_back())
+                    out += closers.back();
+                out += ";\n";
+            }
+            return out;
+        }
+
+        // statements made of `length` operands joined by binary operators of
+        // every precedence
+        inline std::string operator_chains(std::size_t bytes, std::uint32_t seed = 1, int length = 500)
+        {
+            std::mt19937 rng(seed);
+            std::string out;
+            for (std::size_t i = 0; out.size() < bytes; i++)
+            {
+                out += "chain" + std::to_string(i) + " = ";
+                for (int operand = 0; operand < length; operand++)
+                {
+                    if (operand > 0)
+                    {
+                        out += ' ';
+                        out += detail::binary_op(rng);
+                        out += ' ';
+                    }
+                    if (rng() % 2)
+                        out += detail::name(rng);
+                    else
+                        out += std::to_string(rng() % 1000);
+                    if (operand % 16 == 15)
+                        out += "\n   ";
+                }
+                out += ";\n";
+            }
+            return out;
+        }
+
+        // a few lines of comment before every short statement
+        inline std::string comment_heavy(std::size_t bytes, std::uint32_t seed = 1)
+        {
+            std::mt19937 rng(seed);
+            std::string out;
+            for (std::size_t i = 0; out.size() < bytes; i++)
+            {
+                for (auto lines = 2 + rng() % 6; lines > 0; lines--)
+                {
+                    out += "#";
+                    for (auto words = 4 + rng() % 10; words > 0; words--)
+                    {
+                        out += ' ';
+                        out += detail::word(rng);
+                    }
+                    out += "\n";
+                }
+                out += detail::name(rng) + " = " + detail::name(rng) + " + " + std::to_string(i) + "; # trailing note\n";
+            }
+            return out;
+        }
+
+        // long string literals with escapes, passed to calls
+        inline std::string string_heavy(std::size_t bytes, std::uint32_t seed = 1)
+        {
+            std::mt19937 rng(seed);
+            std::string out;
+            for (std::size_t i = 0; out.size() < bytes; i++)
+            {
+                out += "println(\"";
+                for (auto words = 8 + rng() % 40; words > 0; words--)
+                {
+                    out += detail::word(rng);
+                    out += detail::pick(rng, {" ", " ", " ", ", ", "\\n", "\\\"", "\\\\", "\\t"});
+                }
+                out += "\", \"" + std::to_string(i) + "\");\n";
+            }
+            return out;
+        }
+
+        // a huge number of tiny toplevel statements
+        inline std::string many_statements(std::size_t bytes, std::uint32_t seed = 1)
+        {
+            std::mt19937 rng(seed);
+            std::string out;
+            for (std::size_t i = 0; out.size() < bytes; i++)
+            {
+                auto var = [&]
+                {
+                    out += 'v';
+                    out += std::to_string(i);
+                };
+                switch (rng() % 3)
+                {
+                case 0:
+                    var();
+                    out += " = ";
+                    out += std::to_string(rng() % 100);
+                    out += ";\n";
+                    break;
+                case 1:
+                    var();
+                    out += " = ";
+                    out += detail::name(rng);
+                    out += ";\n";
+                    break;
+                default:
+                    out += detail::name(rng);
+                    out += '(';
+                    var();
+                    out += ");\n";
+                    break;
+                }
+            }
+            return out;
+        }
+
+        // a script for the engines and the number of calls running it makes
+        struct program
+        {
+            std::string name;
+            std::string source;
+            std::size_t calls = 0;
+        };
+        // naive recursive fibonacci, nothing but calls and arithmetic
+        inline program fib(int n)
+        {
+            std::size_t a = 0, b = 1;
+            for (int i = 0; i <= n; i++)
+                b = a + b, a = b - a;
+            return {"fib", "fib = lambda(n) if n < 2 then n else fib(n - 1) + fib(n - 2);\nfib(" + std::to_string(n) + ");\n", 2 * a - 1};
+        }
+        // closures made and called `length` times in each of `rounds` rounds
+        inline program closures(int rounds, int length)
+        {
+            std::string source = "adder = lambda(n) lambda(x) x + n;\n"
+                                 "go = lambda(i, acc) if i == 0 then acc else go(i - 1, adder(i)(acc));\n";
+            source += "loop = lambda(k) if k == 0 then 0 else { go(" + std::to_string(length) + ", 0); loop(k - 1) };\n";
+            source += "loop(" + std::to_string(rounds) + ");\n";
+            auto per_round = 3 * static_cast<std::size_t>(length) + 1;
+            return {"closures", std::move(source), static_cast<std::size_t>(rounds) * (per_round + 1) + 1};
+        }
+
+        struct generator
+        {
+            std::string_view name;
+            std::string (*make)(std::size_t bytes, std::uint32_t seed);
+        };
+        inline const generator generators[] = {
+            {"deep_nesting", [](std::size_t bytes, std::uint32_t seed)
+             { return deep_nesting(bytes, seed); }},
+            {"operator_chains", [](std::size_t bytes, std::uint32_t seed)
+             { return operator_chains(bytes, seed); }},
+            {"comment_heavy", comment_heavy},
+            {"string_heavy", string_heavy},
+            {"many_statements", many_statements},
+        };
+    } // namespace corpus
+} // namespace ccpp
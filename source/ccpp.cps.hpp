@@ -0,0 +1,538 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.builtins.hpp"
+#include "ccpp.resolver.hpp"
+#include "ccpp.value.hpp"
+
+namespace ccpp
+{
+    // rewrites an unresolved ast into continuation-passing style: every lambda
+    // takes its continuation as an extra first parameter and every call ends up
+    // in tail position. each toplevel item is converted on its own and returns
+    // to the global %halt. generated names start with % so they can't clash
+    class cps_transform
+    {
+        static constexpr symbol no_symbol = static_cast<symbol>(-1);
+        // the rest of the computation, either a variable holding a
+        // continuation or a function building the code that consumes a value
+        struct cont
+        {
+            symbol var = no_symbol;
+            std::function<node_id(node_id)> fn;
+        };
+
+        const ccpp::ast &in;
+        ccpp::ast out;
+        symbol first_generated = 0;
+        std::size_t generated = 0;
+        std::size_t depth = 0;
+
+        symbol fresh(std::string_view prefix)
+        {
+            return out.symbols->intern("%" + std::string(prefix) + std::to_string(generated++));
+        }
+
+        node_id make_var(symbol name)
+        {
+            auto id = out.make<var_node>(node_kind::var_t);
+            out.get<var_node>(id).name = name;
+            return id;
+        }
+        node_id make_bool(bool v)
+        {
+            auto id = out.make<bool_node>(node_kind::bool_t);
+            out.get<bool_node>(id).value = v;
+            return id;
+        }
+        node_id make_binary(node_kind kind, std::uint8_t op, node_id left, node_id right)
+        {
+            auto id = out.make<binary_node>(kind);
+            auto &n = out.get<binary_node>(id);
+            n.head.op = op;
+            n.left = left;
+            n.right = right;
+            return id;
+        }
+        node_id make_if(node_id cond, node_id then, node_id else_)
+        {
+            auto id = out.make<if_node>(node_kind::if_t);
+            auto &n = out.get<if_node>(id);
+            n.cond = cond;
+            n.then = then;
+            n.else_ = else_;
+            return id;
+        }
+        node_id make_call(node_id func, const std::vector<node_id> &args)
+        {
+            auto id = out.make<call_node>(node_kind::call_t, static_cast<std::uint32_t>(args.size()));
+            out.get<call_node>(id).func = func;
+            std::copy(args.begin(), args.end(), out.children<call_node>(id).begin());
+            return id;
+        }
+        node_id make_lambda(const std::vector<node_id> &vars, node_id body)
+        {
+            auto id = out.make<lambda_node>(node_kind::lambda_t, static_cast<std::uint32_t>(vars.size()));
+            out.get<lambda_node>(id).body = body;
+            std::copy(vars.begin(), vars.end(), out.children<lambda_node>(id).begin());
+            return id;
+        }
+        node_id make_prog(const std::vector<node_id> &items)
+        {
+            auto id = out.make<prog_node>(node_kind::prog_t, static_cast<std::uint32_t>(items.size()));
+            std::copy(items.begin(), items.end(), out.children<prog_node>(id).begin());
+            return id;
+        }
+
+        // no call anywhere inside, so it can be evaluated directly
+        bool trivial(node_id id) const
+        {
+            if (id == no_node)
+                return true;
+            switch (in.kind(id))
+            {
+            case node_kind::call_t:
+                return false;
+            case node_kind::assign_t:
+                return trivial(in.get<binary_node>(id).right);
+            case node_kind::binary_t:
+                return trivial(in.get<binary_node>(id).left) && trivial(in.get<binary_node>(id).right);
+            case node_kind::if_t:
+            {
+                auto &n = in.get<if_node>(id);
+                return trivial(n.cond) && trivial(n.then) && trivial(n.else_);
+            }
+            case node_kind::prog_t:
+                return std::ranges::all_of(in.children<prog_node>(id), [&](node_id item)
+                                           { return trivial(item); });
+            default:
+                return true;
+            }
+        }
+        // a converted value that can be dropped without losing an effect or an error
+        bool droppable(node_id id) const
+        {
+            switch (out.kind(id))
+            {
+            case node_kind::num_t:
+            case node_kind::str_t:
+            case node_kind::bool_t:
+            case node_kind::lambda_t:
+                return true;
+            case node_kind::var_t:
+                return out.get<var_node>(id).name >= first_generated;
+            default:
+                return false;
+            }
+        }
+
+        // the resolver's check, made before the left side is read as a var
+        void assignable(node_id left) const
+        {
+            if (in.kind(left) != node_kind::var_t)
+                throw exception("Cannot assign to " + std::string(to_string(in.kind(left))));
+        }
+
+        // copies a trivial expression, converting the lambdas in it
+        node_id atom(node_id id)
+        {
+            if (id == no_node)
+                return no_node;
+            switch (in.kind(id))
+            {
+            case node_kind::num_t:
+            {
+                auto copy = out.make<num_node>(node_kind::num_t);
+                out.get<num_node>(copy).value = in.get<num_node>(id).value;
+                return copy;
+            }
+            case node_kind::str_t:
+            {
+                auto ref = out.intern_text(in.text(in.get<str_node>(id).value));
+                auto copy = out.make<str_node>(node_kind::str_t);
+                out.get<str_node>(copy).value = ref;
+                return copy;
+            }
+            case node_kind::bool_t:
+                return make_bool(in.get<bool_node>(id).value);
+            case node_kind::var_t:
+                return make_var(in.get<var_node>(id).name);
+            case node_kind::assign_t:
+            case node_kind::binary_t:
+            {
+                auto &n = in.get<binary_node>(id);
+                if (n.head.kind == node_kind::assign_t)
+                    assignable(n.left);
+                auto left = atom(n.left);
+                auto right = atom(n.right);
+                return make_binary(n.head.kind, n.head.op, left, right);
+            }
+            case node_kind::if_t:
+            {
+                auto &n = in.get<if_node>(id);
+                auto cond = atom(n.cond);
+                auto then = atom(n.then);
+                auto else_ = atom(n.else_);
+                return make_if(cond, then, else_);
+            }
+            case node_kind::lambda_t:
+            {
+                auto k = fresh("k");
+                std::vector<node_id> vars{make_var(k)};
+                for (auto var : in.children<lambda_node>(id))
+                    vars.push_back(atom(var));
+                auto body = convert(in.get<lambda_node>(id).body, cont{k, {}});
+                return make_lambda(vars, body);
+            }
+            case node_kind::prog_t:
+            {
+                std::vector<node_id> items;
+                for (auto item : in.children<prog_node>(id))
+                    items.push_back(atom(item));
+                return make_prog(items);
+            }
+            case node_kind::call_t:
+                break;
+            }
+            throw exception("Can't convert " + std::string(to_string(in.kind(id))));
+        }
+
+        node_id apply(const cont &k, node_id v)
+        {
+            if (k.var != no_symbol)
+                return make_call(make_var(k.var), {v});
+            return k.fn(v);
+        }
+        // a continuation value that can be passed to a function
+        node_id reify(const cont &k)
+        {
+            if (k.var != no_symbol)
+                return make_var(k.var);
+            auto v = fresh("v");
+            auto param = make_var(v);
+            auto body = k.fn(make_var(v));
+            return make_lambda({param}, body);
+        }
+        // code that needs `k` in more than one place binds it to a variable
+        // first: (λ(%j) build(%j))(k)
+        node_id join(const cont &k, const std::function<node_id(symbol)> &build)
+        {
+            if (k.var != no_symbol)
+                return build(k.var);
+            auto j = fresh("j");
+            auto param = make_var(j);
+            auto body = build(j);
+            auto lambda = make_lambda({param}, body);
+            return make_call(lambda, {reify(k)});
+        }
+        // evaluates `v` for its effects only, then continues with `rest`
+        node_id sequence(node_id v, node_id rest)
+        {
+            if (droppable(v))
+                return rest;
+            return make_prog({v, rest});
+        }
+        // the items are converted from the back, each into code that goes on
+        // with what was built for the ones after it. only nesting in the
+        // source nests the transform, not the length of a block
+        node_id convert_items(std::span<const node_id> items, const cont &k)
+        {
+            auto rest = convert(items.back(), k);
+            for (auto i = items.size() - 1; i-- > 0;)
+                rest = convert(items[i], cont{no_symbol, [&, next = rest](node_id v)
+                                              { return sequence(v, next); }});
+            return rest;
+        }
+        // the call is made first with its callee and arguments left open, then
+        // they are converted from the back, each continuation filling in its
+        // slot. every continuation is used exactly once, so all get filled
+        node_id convert_call(node_id id, const cont &k)
+        {
+            auto args = in.children<call_node>(id);
+            auto call = make_call(no_node, std::vector<node_id>(args.size() + 1, no_node));
+            out.children<call_node>(call)[0] = reify(k);
+            auto rest = call;
+            for (auto i = args.size(); i-- > 0;)
+                rest = convert(args[i], cont{no_symbol, [&, i, next = rest](node_id v)
+                                             {
+                                                 out.children<call_node>(call)[i + 1] = v;
+                                                 return next; }});
+            return convert(in.get<call_node>(id).func, cont{no_symbol, [&, next = rest](node_id f)
+                                                            {
+                                                                out.get<call_node>(call).func = f;
+                                                                return next; }});
+        }
+
+        node_id convert(node_id id, const cont &k)
+        {
+            if (++depth > max_depth)
+                throw exception("Expression nested too deeply");
+            auto result = convert_serious(id, k);
+            depth--;
+            return result;
+        }
+        node_id convert_serious(node_id id, const cont &k)
+        {
+            if (trivial(id))
+                return apply(k, atom(id));
+            switch (in.kind(id))
+            {
+            case node_kind::assign_t:
+            {
+                auto &n = in.get<binary_node>(id);
+                assignable(n.left);
+                auto name = in.get<var_node>(n.left).name;
+                return convert(n.right, cont{no_symbol, [&](node_id r)
+                                             { return apply(k, make_binary(node_kind::assign_t, n.head.op, make_var(name), r)); }});
+            }
+            case node_kind::binary_t:
+            {
+                auto &n = in.get<binary_node>(id);
+                auto op = static_cast<op_kind>(n.head.op);
+                if (op == op_kind::and_ || op == op_kind::or_)
+                    return convert(n.left, cont{no_symbol, [&](node_id l)
+                                                { return join(k, [&](symbol j)
+                                                              {
+                                                                  auto right = convert(n.right, cont{j, {}});
+                                                                  auto other = make_call(make_var(j), {make_bool(op == op_kind::or_)});
+                                                                  return op == op_kind::and_ ? make_if(l, right, other) : make_if(l, other, right); }); }});
+                return convert(n.left, cont{no_symbol, [&](node_id l)
+                                            { return convert(n.right, cont{no_symbol, [&](node_id r)
+                                                                           { return apply(k, make_binary(node_kind::binary_t, n.head.op, l, r)); }}); }});
+            }
+            case node_kind::call_t:
+                return convert_call(id, k);
+            case node_kind::if_t:
+            {
+                auto &n = in.get<if_node>(id);
+                return convert(n.cond, cont{no_symbol, [&](node_id c)
+                                            { return join(k, [&](symbol j)
+                                                          {
+                                                              auto then = convert(n.then, cont{j, {}});
+                                                              auto else_ = n.else_ != no_node ? convert(n.else_, cont{j, {}}) : make_call(make_var(j), {make_bool(false)});
+                                                              return make_if(c, then, else_); }); }});
+            }
+            case node_kind::prog_t:
+            {
+                auto items = in.children<prog_node>(id);
+                return convert_items(std::span<const node_id>(items.data(), items.size()), k);
+            }
+            default:
+                throw exception("Can't convert " + std::string(to_string(in.kind(id))));
+            }
+        }
+
+    public:
+        // bounds the native recursion of the transform itself. a chain of
+        // calls converts two levels deep per link, each of them over 1 KB of
+        // stack unoptimized, so this is tighter than the parser's bound
+        std::size_t max_depth = 1 << 12;
+
+        cps_transform(const ccpp::ast &tree) : in(tree) {}
+        // the result is a prog with one converted item per toplevel item
+        ccpp::ast transform()
+        {
+            out = ccpp::ast();
+            out.symbols = in.symbols;
+            auto halt = out.symbols->intern("%halt");
+            first_generated = static_cast<symbol>(out.symbols->size());
+            std::vector<node_id> items;
+            if (in.kind(in.root) == node_kind::prog_t)
+                for (auto item : in.children<prog_node>(in.root))
+                    items.push_back(convert(item, cont{halt, {}}));
+            else
+                items.push_back(convert(in.root, cont{halt, {}}));
+            out.root = make_prog(items);
+            return std::move(out);
+        }
+    };
+
+    // trampoline for the output of cps_transform: calls never return, so the
+    // loop below replaces the current expression instead of recursing and
+    // deep recursion in scripts only grows the chain of continuations on the heap
+    class cps_evaluator
+    {
+        struct frame
+        {
+            std::shared_ptr<frame> parent;
+            std::vector<value> slots;
+        };
+        struct closure : object
+        {
+            node_id lambda;
+            std::shared_ptr<frame> env;
+
+            closure(node_id lambda, std::shared_ptr<frame> env) : object(object_kind::closure), lambda(lambda), env(std::move(env)) {}
+        };
+
+        ccpp::ast tree;
+        // indexed by symbol id
+        std::vector<value> globals;
+        value halt;
+
+        value &lookup(const var_node &var, frame *env)
+        {
+            if (static_cast<var_scope>(var.head.op) == var_scope::local)
+            {
+                for (auto depth = var.head.flags; depth > 0; depth--)
+                    env = env->parent.get();
+                return env->slots[var.head.count];
+            }
+            if (var.head.count >= globals.size())
+                globals.resize(tree.symbols->size());
+            return globals[var.head.count];
+        }
+
+        // expressions without calls, recursion is bounded by the source nesting
+        value evaluate(node_id id, const std::shared_ptr<frame> &env)
+        {
+            switch (tree.kind(id))
+            {
+            case node_kind::num_t:
+                return value::number(tree.get<num_node>(id).value);
+            case node_kind::str_t:
+                return value::string(std::string(tree.text(tree.get<str_node>(id).value)));
+            case node_kind::bool_t:
+                return tree.get<bool_node>(id).value;
+            case node_kind::var_t:
+            {
+                auto &var = tree.get<var_node>(id);
+                auto &slot = lookup(var, env.get());
+                if (slot.is_nil())
+                    throw exception("Undefined variable " + std::string(tree.symbols->name(var.name)));
+                return slot;
+            }
+            case node_kind::assign_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                auto v = evaluate(n.right, env);
+                return lookup(tree.get<var_node>(n.left), env.get()) = v;
+            }
+            case node_kind::binary_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                auto op = static_cast<op_kind>(n.head.op);
+                auto left = evaluate(n.left, env);
+                if (op == op_kind::and_)
+                    return left.truthy() ? evaluate(n.right, env) : value(false);
+                if (op == op_kind::or_)
+                    return left.truthy() ? value(true) : evaluate(n.right, env);
+                return apply_op(op, left, evaluate(n.right, env));
+            }
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                if (evaluate(n.cond, env).truthy())
+                    return evaluate(n.then, env);
+                return n.else_ != no_node ? evaluate(n.else_, env) : value(false);
+            }
+            case node_kind::lambda_t:
+                return make_object<closure>(id, env);
+            case node_kind::prog_t:
+            {
+                value result(false);
+                for (auto item : tree.children<prog_node>(id))
+                    result = evaluate(item, env);
+                return result;
+            }
+            case node_kind::call_t:
+                break;
+            }
+            throw exception("Can't evaluate " + std::string(to_string(tree.kind(id))));
+        }
+
+        // runs one converted toplevel item until it calls %halt
+        value execute(node_id id)
+        {
+            std::shared_ptr<frame> env;
+            std::vector<value> args;
+            for (;;)
+            {
+                switch (tree.kind(id))
+                {
+                case node_kind::if_t:
+                {
+                    auto &n = tree.get<if_node>(id);
+                    id = evaluate(n.cond, env).truthy() ? n.then : n.else_;
+                    continue;
+                }
+                case node_kind::prog_t:
+                {
+                    auto items = tree.children<prog_node>(id);
+                    for (std::size_t i = 0; i + 1 < items.size(); i++)
+                        evaluate(items[i], env);
+                    id = items.back();
+                    continue;
+                }
+                case node_kind::call_t:
+                    break;
+                default:
+                    throw exception("Can't execute " + std::string(to_string(tree.kind(id))));
+                }
+                value callee = evaluate(tree.get<call_node>(id).func, env);
+                args.clear();
+                for (auto arg : tree.children<call_node>(id))
+                    args.push_back(evaluate(arg, env));
+                // natives are direct style: run them and pass the result on
+                while (callee.is(object_kind::native))
+                {
+                    if (callee.raw() == halt.raw())
+                        return args.empty() ? value(false) : args[0];
+                    if (args.empty())
+                        throw exception("Missing continuation");
+                    auto result = static_cast<native_object *>(callee.as_object())->fn(std::span<const value>(args).subspan(1));
+                    callee = std::move(args[0]);
+                    args.assign(1, std::move(result));
+                }
+                if (!callee.is(object_kind::closure))
+                    throw exception(callee.to_string() + " is not a function");
+                auto &fn = *static_cast<closure *>(callee.as_object());
+                auto next = std::make_shared<frame>();
+                next->parent = fn.env;
+                next->slots = std::move(args);
+                next->slots.resize(tree.get<lambda_node>(fn.lambda).head.count, value(false));
+                id = tree.get<lambda_node>(fn.lambda).body;
+                env = std::move(next);
+            }
+        }
+
+    public:
+        cps_evaluator(const ccpp::ast &source, std::ostream &out = std::cout) : tree(cps_transform(source).transform())
+        {
+            resolver(tree).resolve();
+            halt = make_object<native_object>("%halt", [](std::span<const value>)
+                                              { return value(false); });
+            define("%halt", halt);
+            define_builtins([&](std::string_view name, value v)
+                            { define(name, std::move(v)); },
+                            out);
+        }
+        void define(std::string_view name, value v)
+        {
+            auto id = tree.symbols->intern(name);
+            if (id >= globals.size())
+                globals.resize(tree.symbols->size());
+            globals[id] = std::move(v);
+        }
+        value run()
+        {
+            value result(false);
+            for (auto item : tree.children<prog_node>(tree.root))
+                result = execute(item);
+            return result;
+        }
+        const ccpp::ast &program() const
+        {
+            return tree;
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// a result only stays in registers while the productions passing it on are
+// inlined into each other, and the reporting is kept out of their way
+#if defined(__GNUC__) || defined(__clang__)
+#define CCPP_INLINE inline __attribute__((always_inline))
+#define CCPP_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define CCPP_INLINE __forceinline
+#define CCPP_COLD __declspec(noinline)
+#else
+#define CCPP_INLINE inline
+#define CCPP_COLD
+#endif
+
+namespace ccpp
+{
+    // source text a node or a problem covers, as byte offsets [begin, end)
+    struct source_span
+    {
+        std::uint32_t begin = 0;
+        std::uint32_t end = 0;
+    };
+
+    enum class severity : std::uint8_t
+    {
+        note,
+        warning,
+        error,
+    };
+    inline std::string_view to_string(severity level)
+    {
+        switch (level)
+        {
+        case severity::note:
+            return "note";
+        case severity::warning:
+            return "warning";
+        case severity::error:
+            return "error";
+        }
+        return "unknown";
+    }
+
+    // one problem found in a source. line and col are where its span starts,
+    // which is what an exception for it reports too
+    struct diagnostic
+    {
+        severity level = severity::error;
+        source_span span;
+        int line = 0;
+        int col = 0;
+        std::string message;
+
+        // the text of the exception thrown for it without a diagnostics sink
+        std::string text() const
+        {
+            return message + " (" + std::to_string(line) + ":" + std::to_string(col) + ")";
+        }
+    };
+
+    // a production that gave up, its diagnostic is already reported. small
+    // enough that a result<node_id> is one register
+    struct failure
+    {
+        std::uint32_t diagnostic = 0;
+    };
+    template <typename T>
+    using result = std::expected<T, failure>;
+
+    // collects the problems of a lexer and parser run instead of stopping at
+    // the first one
+    class diagnostics
+    {
+        std::vector<diagnostic> entries;
+        std::size_t errors_ = 0;
+
+    public:
+        failure report(diagnostic problem)
+        {
+            if (problem.level == severity::error)
+                errors_++;
+            entries.push_back(std::move(problem));
+            return {static_cast<std::uint32_t>(entries.size() - 1)};
+        }
+        const diagnostic &operator[](std::size_t i) const
+        {
+            return entries[i];
+        }
+        std::vector<diagnostic>::const_iterator begin() const
+        {
+            return entries.begin();
+        }
+        std::vector<diagnostic>::const_iterator end() const
+        {
+            return entries.end();
+        }
+        std::size_t size() const
+        {
+            return entries.size();
+        }
+        std::size_t errors() const
+        {
+            return errors_;
+        }
+        void clear()
+        {
+            entries.clear();
+            errors_ = 0;
+        }
+        // one `name:line:col: severity: message` line each
+        void print(std::ostream &os, std::string_view name) const
+        {
+            for (auto &d : entries)
+                os << name << ':' << d.line << ':' << d.col << ": " << to_string(d.level) << ": " << d.message << '\n';
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+
+namespace ccpp
+{
+    // what closure conversion needs to know about one lambda
+    struct lambda_info
+    {
+        static constexpr std::uint32_t no_box = std::numeric_limits<std::uint32_t>::max();
+
+        // the closure may outlive the activation that created it. only a lambda
+        // called right where it is written, outside tail position, does not
+        bool escapes = true;
+        // reads or writes a boxed variable of an enclosing lambda, so the closure
+        // has to carry the enclosing heap frame
+        bool needs_env = false;
+        // per parameter, its slot in the heap frame or no_box if it stays on the stack
+        std::vector<std::uint32_t> box;
+        // the boxed parameters in heap frame order
+        std::vector<std::uint32_t> boxed;
+    };
+
+    // finds the parameters captured by escaping closures over a resolved ast.
+    // those are boxed into a heap frame, everything else stays in the caller's
+    // stack slots, reachable from non-escaping lambdas through the activations
+    class escape_analysis
+    {
+        const ccpp::ast &tree;
+        std::unordered_map<node_id, lambda_info> lambdas;
+        // enclosing lambdas, innermost last
+        std::vector<node_id> scopes;
+        bool boxing = true;
+
+        void reference(const var_node &var)
+        {
+            if (static_cast<var_scope>(var.head.op) != var_scope::local || var.head.flags == 0)
+                return;
+            auto depth = var.head.flags;
+            auto &owner = lambdas[scopes[scopes.size() - 1 - depth]];
+            if (boxing)
+            {
+                for (std::size_t i = scopes.size() - depth; i < scopes.size(); i++)
+                    if (lambdas[scopes[i]].escapes)
+                        owner.box[var.head.count] = 0;
+                return;
+            }
+            if (owner.box[var.head.count] == lambda_info::no_box)
+                return;
+            for (std::size_t i = scopes.size() - depth; i < scopes.size(); i++)
+                lambdas[scopes[i]].needs_env = true;
+        }
+        // mirrors the compiler's idea of tail position
+        void visit(node_id id, bool tail, bool escapes = true)
+        {
+            if (id == no_node)
+                return;
+            switch (tree.kind(id))
+            {
+            case node_kind::num_t:
+            case node_kind::str_t:
+            case node_kind::bool_t:
+                return;
+            case node_kind::var_t:
+                reference(tree.get<var_node>(id));
+                return;
+            case node_kind::assign_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                reference(tree.get<var_node>(n.left));
+                visit(n.right, false);
+                return;
+            }
+            case node_kind::binary_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                auto op = static_cast<op_kind>(n.head.op);
+                visit(n.left, false);
+                visit(n.right, tail && (op == op_kind::and_ || op == op_kind::or_));
+                return;
+            }
+            case node_kind::call_t:
+            {
+                auto func = tree.get<call_node>(id).func;
+                visit(func, false, tail || tree.kind(func) != node_kind::lambda_t);
+                for (auto arg : tree.children<call_node>(id))
+                    visit(arg, false);
+                return;
+            }
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                visit(n.cond, false);
+                visit(n.then, tail);
+                visit(n.else_, tail);
+                return;
+            }
+            case node_kind::lambda_t:
+            {
+                auto &info = lambdas[id];
+                if (boxing)
+                {
+                    info.escapes = escapes;
+                    info.box.assign(tree.get<lambda_node>(id).head.count, lambda_info::no_box);
+                }
+                scopes.push_back(id);
+                visit(tree.get<lambda_node>(id).body, true);
+                scopes.pop_back();
+                return;
+            }
+            case node_kind::prog_t:
+            {
+                auto items = tree.children<prog_node>(id);
+                for (std::size_t i = 0; i < items.size(); i++)
+                    visit(items[i], tail && i + 1 == items.size());
+                return;
+            }
+            }
+        }
+
+    public:
+        escape_analysis(const ccpp::ast &tree) : tree(tree) {}
+        // the toplevel is not in tail position, it has no activation to replace
+        std::unordered_map<node_id, lambda_info> analyze()
+        {
+            lambdas.clear();
+            boxing = true;
+            visit(tree.root, false);
+            for (auto &[id, info] : lambdas)
+            {
+                info.boxed.clear();
+                for (std::uint32_t slot = 0; slot < info.box.size(); slot++)
+                {
+                    if (info.box[slot] == lambda_info::no_box)
+                        continue;
+                    info.box[slot] = static_cast<std::uint32_t>(info.boxed.size());
+                    info.boxed.push_back(slot);
+                }
+            }
+            boxing = false;
+            visit(tree.root, false);
+            return std::move(lambdas);
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.builtins.hpp"
+#include "ccpp.resolver.hpp"
+#include "ccpp.value.hpp"
+
+namespace ccpp
+{
+    // tree-walking interpreter over a resolved ast
+    class evaluator
+    {
+        // one activation of a lambda, slots are its parameters
+        struct frame
+        {
+            std::shared_ptr<frame> parent;
+            std::vector<value> slots;
+        };
+        struct closure : object
+        {
+            node_id lambda;
+            std::shared_ptr<frame> env;
+
+            closure(node_id lambda, std::shared_ptr<frame> env) : object(object_kind::closure), lambda(lambda), env(std::move(env)) {}
+        };
+
+        ccpp::ast &tree;
+        // indexed by symbol id
+        std::vector<value> globals;
+        // lambda calls running now
+        std::size_t depth = 0;
+
+        value &lookup(const var_node &var, frame *env)
+        {
+            if (static_cast<var_scope>(var.head.op) == var_scope::local)
+            {
+                for (auto depth = var.head.flags; depth > 0; depth--)
+                    env = env->parent.get();
+                return env->slots[var.head.count];
+            }
+            if (var.head.count >= globals.size())
+                globals.resize(tree.symbols->size());
+            return globals[var.head.count];
+        }
+        value call(const value &func, std::vector<value> args)
+        {
+            if (func.is(object_kind::native))
+                return static_cast<native_object *>(func.as_object())->fn(args);
+            if (!func.is(object_kind::closure))
+                throw exception(func.to_string() + " is not a function");
+            if (depth >= max_depth)
+                throw exception("Stack overflow");
+            depth++;
+            struct leave
+            {
+                std::size_t &depth;
+                ~leave() { depth--; }
+            } guard{depth};
+            auto &fn = *static_cast<closure *>(func.as_object());
+            auto env = std::make_shared<frame>();
+            env->parent = fn.env;
+            env->slots = std::move(args);
+            env->slots.resize(tree.get<lambda_node>(fn.lambda).head.count, value(false));
+            return evaluate(tree.get<lambda_node>(fn.lambda).body, env);
+        }
+
+        // the cases of evaluate with locals of their own live out here, every
+        // level of a nested expression or call then only pays for the small
+        // frame of evaluate itself
+        value literal(node_id id)
+        {
+            return value::string(std::string(tree.text(tree.get<str_node>(id).value)));
+        }
+        value load(node_id id, const std::shared_ptr<frame> &env)
+        {
+            auto &var = tree.get<var_node>(id);
+            auto &slot = lookup(var, env.get());
+            if (slot.is_nil())
+                throw exception("Undefined variable " + std::string(tree.symbols->name(var.name)));
+            return slot;
+        }
+        value store(node_id id, const std::shared_ptr<frame> &env)
+        {
+            auto &n = tree.get<binary_node>(id);
+            auto v = evaluate(n.right, env);
+            return lookup(tree.get<var_node>(n.left), env.get()) = v;
+        }
+        value binary(node_id id, const std::shared_ptr<frame> &env)
+        {
+            auto &n = tree.get<binary_node>(id);
+            auto op = static_cast<op_kind>(n.head.op);
+            auto left = evaluate(n.left, env);
+            if (op == op_kind::and_)
+                return left.truthy() ? evaluate(n.right, env) : value(false);
+            if (op == op_kind::or_)
+                return left.truthy() ? value(true) : evaluate(n.right, env);
+            return apply_op(op, left, evaluate(n.right, env));
+        }
+        value call(node_id id, const std::shared_ptr<frame> &env)
+        {
+            auto func = evaluate(tree.get<call_node>(id).func, env);
+            std::vector<value> args;
+            args.reserve(tree.children<call_node>(id).size());
+            for (auto arg : tree.children<call_node>(id))
+                args.push_back(evaluate(arg, env));
+            return call(func, std::move(args));
+        }
+        value sequence(node_id id, const std::shared_ptr<frame> &env)
+        {
+            value result(false);
+            for (auto item : tree.children<prog_node>(id))
+                result = evaluate(item, env);
+            return result;
+        }
+        CCPP_COLD [[noreturn]] void unknown(node_id id)
+        {
+            throw exception("Can't evaluate " + std::string(to_string(tree.kind(id))));
+        }
+
+    public:
+        // every call, tail or not, recurses on the native stack, deeper than
+        // this is reported instead of overflowing it. a call costs under 1 KB
+        // of stack in optimized and unoptimized builds alike, this leaves room
+        // on an 8 MB stack for the expressions each call nests in, which the
+        // parser bounds. the vm keeps its frames on the heap and goes deeper
+        std::size_t max_depth = 1 << 13;
+
+        evaluator(ccpp::ast &tree, std::ostream &out = std::cout) : tree(tree)
+        {
+            resolver(tree).resolve();
+            define_builtins([&](std::string_view name, value v)
+                            { define(name, std::move(v)); },
+                            out);
+        }
+        void define(std::string_view name, value v)
+        {
+            auto id = tree.symbols->intern(name);
+            if (id >= globals.size())
+                globals.resize(tree.symbols->size());
+            globals[id] = std::move(v);
+        }
+        value run()
+        {
+            return evaluate(tree.root, nullptr);
+        }
+        // appends `statement`, a toplevel statement parsed on its own with the
+        // same symbols, to the tree and runs it. it sees the globals the ones
+        // before it set, and the tree keeps it for the closures it makes
+        value run(const ccpp::ast &statement)
+        {
+            auto at = tree.reserve(std::span(&statement, 1));
+            tree.place(statement, at[0]);
+            tree.root = statement.root + at[0].node;
+            resolver(tree).resolve();
+            return run();
+        }
+        value evaluate(node_id id, const std::shared_ptr<frame> &env)
+        {
+            switch (tree.kind(id))
+            {
+            case node_kind::num_t:
+                return value::number(tree.get<num_node>(id).value);
+            case node_kind::str_t:
+                return literal(id);
+            case node_kind::bool_t:
+                return tree.get<bool_node>(id).value;
+            case node_kind::var_t:
+                return load(id, env);
+            case node_kind::assign_t:
+                return store(id, env);
+            case node_kind::binary_t:
+                return binary(id, env);
+            case node_kind::call_t:
+                return call(id, env);
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                if (evaluate(n.cond, env).truthy())
+                    return evaluate(n.then, env);
+                return n.else_ != no_node ? evaluate(n.else_, env) : value(false);
+            }
+            case node_kind::lambda_t:
+                return make_object<closure>(id, env);
+            case node_kind::prog_t:
+                return sequence(id, env);
+            }
+            unknown(id);
+        }
+    };
+} // namespace ccpp
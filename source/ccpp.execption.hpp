@@ -8,10 +8,10 @@ namespace ccpp
     {
     public:
         exception(const char *msg) : message(msg) {}
-        exception(const std::string &msg) : message(msg.c_str()) {}
-        const char *what() const noexcept override { return message; }
+        exception(const std::string &msg) : message(msg) {}
+        const char *what() const noexcept override { return message.c_str(); }
 
     private:
-        const char *message;
+        std::string message;
     };
 } // namespace ccpp
\ No newline at end of file
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.input_stream.hpp"
+#include "ccpp.lexeme.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.symbol_table.hpp"
+#include "ccpp.token_stream.hpp"
+
+namespace ccpp
+{
+    // `removed` bytes at `offset` replaced by `inserted`
+    struct text_edit
+    {
+        std::size_t offset = 0;
+        std::size_t removed = 0;
+        std::string_view inserted;
+    };
+
+    // keeps a source lexed and parsed across edits, for editor tooling. the
+    // toplevel is held as statements cut at `;` outside brackets, each owning
+    // its text, tokens, arena and blocks, all relative to where it starts.
+    // statements away from an edit are left alone, only the index of where
+    // they start changes. in the statements an edit touches, tokens before it
+    // are kept, tokens after it are kept once the lexer lines up with them
+    // again, and `{}` blocks away from it are copied instead of parsed
+    class incremental_parser
+    {
+        struct statement
+        {
+            std::string text;
+            // ending with the `;` that closes the statement unless it is the last one
+            std::vector<lexeme> tokens;
+            ccpp::ast tree;
+            // the statement itself, none if it is empty
+            std::vector<node_id> roots;
+            // in the order they were completed, so the blocks nested in one
+            // come right before it
+            std::vector<parser::block> blocks;
+            bool failed = false;
+            // lexing stopped at an error after the last token, which makes
+            // this the last statement
+            bool truncated = false;
+        };
+        // the statements an edit replaces, lexed but not yet parsed
+        struct damage
+        {
+            // the edited text of the replaced statements and maybe a few after
+            std::string window;
+            std::vector<statement> statements;
+            // where they start in the window
+            std::vector<std::size_t> starts;
+            // the first old statement after them
+            std::size_t resume = 0;
+        };
+        // blocks of the replaced statements that an edit didn't touch, by where
+        // they start in the window, as (statement, block)
+        using reusable = std::unordered_map<std::size_t, std::pair<std::size_t, std::size_t>>;
+
+        // prefix sums over the statement lengths (a fenwick tree), so moving
+        // every statement after an edit costs log n
+        class extents
+        {
+            std::vector<std::size_t> sums;
+
+        public:
+            void assign(const std::vector<statement> &statements)
+            {
+                auto n = statements.size();
+                sums.assign(n + 1, 0);
+                for (std::size_t i = 1; i <= n; i++)
+                {
+                    sums[i] += statements[i - 1].text.size();
+                    if (auto up = i + (i & -i); up <= n)
+                        sums[up] += sums[i];
+                }
+            }
+            void add(std::size_t i, std::ptrdiff_t delta)
+            {
+                for (i++; i < sums.size(); i += i & -i)
+                    sums[i] += static_cast<std::size_t>(delta);
+            }
+            // where statement i starts
+            std::size_t start(std::size_t i) const
+            {
+                std::size_t sum = 0;
+                for (; i > 0; i -= i & -i)
+                    sum += sums[i];
+                return sum;
+            }
+            // the last statement starting at or before `offset`
+            std::size_t find(std::size_t offset) const
+            {
+                auto n = sums.size() - 1;
+                std::size_t i = 0;
+                for (auto step = std::bit_floor(n); step > 0; step >>= 1)
+                    if (i + step <= n && sums[i + step] <= offset)
+                    {
+                        i += step;
+                        offset -= sums[i];
+                    }
+                return std::min(i, n - 1);
+            }
+        };
+
+        std::shared_ptr<ccpp::symbol_table> table;
+        std::vector<statement> statements;
+        extents index;
+        std::size_t failures = 0;
+
+        // lexes the statements from `first` on with the edit applied until a
+        // statement boundary lines up with an old one, copying the tokens that
+        // can't have changed. false if that takes more text than the window
+        // of statements [first, limit)
+        bool relex(const text_edit &edit, std::size_t first, std::size_t limit, damage &d)
+        {
+            auto offset = edit.offset - index.start(first);
+            auto edited = offset + edit.inserted.size();
+            auto old_end = offset + edit.removed;
+            auto delta = static_cast<std::ptrdiff_t>(edit.inserted.size()) - static_cast<std::ptrdiff_t>(edit.removed);
+            bool whole = limit == statements.size();
+
+            d = damage();
+            for (auto i = first; i < limit; i++)
+                d.window += statements[i].text;
+            d.window.replace(offset, edit.removed, edit.inserted);
+            d.resume = statements.size();
+
+            // old tokens from the end of the edit on, in old window offsets
+            auto oi = first;
+            std::size_t old_base = 0;
+            while (oi + 1 < statements.size() && old_base + statements[oi].text.size() <= old_end)
+                old_base += statements[oi++].text.size();
+            auto ot = static_cast<std::size_t>(std::ranges::lower_bound(statements[oi].tokens, old_end - old_base, {}, &lexeme::offset) -
+                                               statements[oi].tokens.begin());
+            auto settle = [&]
+            {
+                while (oi < statements.size() && ot == statements[oi].tokens.size())
+                    old_base += statements[oi++].text.size(), ot = 0;
+            };
+            auto old_offset = [&]
+            {
+                return static_cast<std::ptrdiff_t>(old_base + statements[oi].tokens[ot].offset) + delta;
+            };
+            settle();
+
+            std::size_t start = 0;
+            d.starts.push_back(start);
+            d.statements.emplace_back();
+            int depth = 0;
+            // takes the next token in window offsets, true once the rest is unchanged
+            auto emit = [&](lexeme tok)
+            {
+                if (tok.kind == lexeme_kind::punc)
+                {
+                    if (tok.ch == '(' || tok.ch == '{' || tok.ch == '[')
+                        depth++;
+                    else if (tok.ch == ')' || tok.ch == '}' || tok.ch == ']')
+                        depth--;
+                }
+                std::size_t end = tok.offset + tok.length;
+                bool closes = tok.kind == lexeme_kind::punc && tok.ch == ';' && depth == 0;
+                tok.offset -= static_cast<std::uint32_t>(start);
+                d.statements.back().tokens.push_back(tok);
+                if (!closes)
+                    return false;
+                if (end >= edited)
+                {
+                    auto old = index.start(first) + static_cast<std::size_t>(static_cast<std::ptrdiff_t>(end) - delta);
+                    auto j = index.find(old);
+                    if (j > first && index.start(j) == old)
+                    {
+                        d.resume = j;
+                        return true;
+                    }
+                }
+                start = end;
+                d.starts.push_back(start);
+                d.statements.emplace_back();
+                return false;
+            };
+
+            // the tokens ending before the edit can't have changed
+            std::size_t restart = 0;
+            for (auto tok : statements[first].tokens)
+            {
+                if (tok.offset + tok.length >= offset)
+                    break;
+                restart = tok.offset + tok.length;
+                emit(tok);
+            }
+
+            ccpp::input_stream is{std::string_view(d.window)};
+            is.seek(restart);
+            token_stream ts(is, table);
+            try
+            {
+                for (;;)
+                {
+                    auto tok = ts.next();
+                    if (tok.kind == lexeme_kind::eof)
+                        return whole;
+                    // a token running into the end of the window may go on after it
+                    if (!whole && tok.offset + tok.length >= d.window.size() && tok.kind != lexeme_kind::punc)
+                        return false;
+                    bool lined_up = false;
+                    if (tok.offset >= edited)
+                    {
+                        while (oi < statements.size() && old_offset() < tok.offset)
+                            ot++, settle();
+                        lined_up = oi < statements.size() && old_offset() == tok.offset;
+                    }
+                    if (emit(tok))
+                        return true;
+                    if (lined_up)
+                        break;
+                }
+            }
+            catch (const exception &)
+            {
+                if (!whole)
+                    return false;
+                // the lexer can't go on, the rest of the source is one bad statement
+                d.statements.back().failed = true;
+                d.statements.back().truncated = true;
+                return true;
+            }
+
+            // lexing from here would give the old tokens again, and the same
+            // error if the old ones ended in one
+            for (ot++, settle(); oi < statements.size(); ot++, settle())
+            {
+                if (oi >= limit)
+                    return false;
+                auto tok = statements[oi].tokens[ot];
+                tok.offset = static_cast<std::uint32_t>(old_offset());
+                if (emit(tok))
+                    return true;
+            }
+            // the old tokens ran out, possibly in a statement past the window
+            // that has none
+            if (!whole)
+                return false;
+            if (statements.back().truncated)
+            {
+                d.statements.back().failed = true;
+                d.statements.back().truncated = true;
+            }
+            return true;
+        }
+
+        reusable blocks_around(const text_edit &edit, std::size_t first, std::size_t last) const
+        {
+            auto offset = edit.offset - index.start(first);
+            auto delta = static_cast<std::ptrdiff_t>(edit.inserted.size()) - static_cast<std::ptrdiff_t>(edit.removed);
+            reusable blocks;
+            std::size_t start = 0;
+            for (auto i = first; i < last; start += statements[i++].text.size())
+                for (std::size_t b = 0; b < statements[i].blocks.size(); b++)
+                {
+                    auto &span = statements[i].blocks[b].span;
+                    if (start + span.end <= offset)
+                        blocks.emplace(start + span.begin, std::pair(i, b));
+                    else if (start + span.begin >= offset + edit.removed)
+                        blocks.emplace(static_cast<std::size_t>(static_cast<std::ptrdiff_t>(start + span.begin) + delta), std::pair(i, b));
+                }
+            return blocks;
+        }
+
+        // parses a statement that starts at `start` in the window, copying the
+        // blocks in `reuse` from the old statements
+        void parse(statement &s, std::size_t start, bool closed, const reusable &reuse)
+        {
+            if (s.failed)
+                return;
+            auto tokens = std::span<const lexeme>(s.tokens).first(s.tokens.size() - (closed ? 1 : 0));
+            auto stop = closed ? s.tokens.back().offset : s.text.size();
+            parser p(token_stream(input_stream(std::string_view(s.text)), tokens, stop, table));
+            p.blocks = &s.blocks;
+            p.reuse = [&](ccpp::ast &tree, std::size_t begin, std::size_t &end)
+            {
+                auto it = reuse.find(start + begin);
+                if (it == reuse.end())
+                    return no_node;
+                auto &old = statements[it->second.first];
+                auto b = it->second.second;
+                auto &block = old.blocks[b];
+                auto shift = static_cast<std::int64_t>(begin) - block.span.begin;
+                auto text = tree.next_text();
+                auto first = tree.copy(old.tree, block.first, block.last, block.text, shift);
+                // the blocks nested in it come along
+                auto moved = [&](parser::block nested)
+                {
+                    nested.span.begin = static_cast<std::uint32_t>(nested.span.begin + shift);
+                    nested.span.end = static_cast<std::uint32_t>(nested.span.end + shift);
+                    nested.node += first - block.first;
+                    nested.first += first - block.first;
+                    nested.last += first - block.first;
+                    nested.text.offset += text - block.text.offset;
+                    return nested;
+                };
+                auto lo = b;
+                while (lo > 0 && old.blocks[lo - 1].first >= block.first)
+                    lo--;
+                for (auto i = lo; i < b; i++)
+                    s.blocks.push_back(moved(old.blocks[i]));
+                end = moved(block).span.end;
+                return moved(block).node;
+            };
+            try
+            {
+                s.tree = p.parse_statements(s.roots);
+                s.failed = closed && s.roots.empty();
+            }
+            catch (const exception &)
+            {
+                // the blocks went down with the tree
+                s.failed = true;
+                s.blocks.clear();
+                s.roots.clear();
+            }
+        }
+
+    public:
+        incremental_parser(std::string_view text, std::shared_ptr<ccpp::symbol_table> symbols = std::make_shared<ccpp::symbol_table>())
+            : table(std::move(symbols))
+        {
+            statements.emplace_back();
+            index.assign(statements);
+            edit({0, 0, text});
+        }
+
+        void edit(const text_edit &edit)
+        {
+            auto size = index.start(statements.size());
+            if (edit.offset > size || edit.removed > size - edit.offset)
+                throw exception("Edit out of range");
+            auto first = index.find(edit.offset);
+            // the statements the edit touches and one more, doubled until the
+            // lexer lines up with the old tokens inside it
+            auto limit = std::min(statements.size(), index.find(edit.offset + edit.removed) + 2);
+            damage d;
+            while (!relex(edit, first, limit, d))
+                limit = std::min(statements.size(), first + 2 * (limit - first));
+
+            // the last new statement ends where the first kept one starts
+            auto reuse = blocks_around(edit, first, d.resume);
+            auto end = d.window.size() - (index.start(limit) - index.start(d.resume));
+            for (std::size_t i = 0; i < d.statements.size(); i++)
+            {
+                auto &s = d.statements[i];
+                bool last = i + 1 == d.statements.size();
+                auto next = last ? end : d.starts[i + 1];
+                s.text = d.window.substr(d.starts[i], next - d.starts[i]);
+                parse(s, d.starts[i], !last || d.resume < statements.size(), reuse);
+            }
+
+            for (auto i = first; i < d.resume; i++)
+                failures -= statements[i].failed;
+            for (auto &s : d.statements)
+                failures += s.failed;
+            auto from = static_cast<std::ptrdiff_t>(first), to = static_cast<std::ptrdiff_t>(d.resume);
+            if (to - from == static_cast<std::ptrdiff_t>(d.statements.size()))
+            {
+                // as many statements came back as went, nothing else moves
+                for (std::size_t i = 0; i < d.statements.size(); i++)
+                {
+                    auto &old = statements[first + i];
+                    index.add(first + i, static_cast<std::ptrdiff_t>(d.statements[i].text.size()) - static_cast<std::ptrdiff_t>(old.text.size()));
+                    old = std::move(d.statements[i]);
+                }
+                return;
+            }
+            statements.erase(statements.begin() + from, statements.begin() + to);
+            statements.insert(statements.begin() + from, std::make_move_iterator(d.statements.begin()), std::make_move_iterator(d.statements.end()));
+            index.assign(statements);
+        }
+
+        std::string text() const
+        {
+            std::string text;
+            text.reserve(index.start(statements.size()));
+            for (auto &s : statements)
+                text += s.text;
+            return text;
+        }
+        // whether the source parses, without parsing it
+        bool valid() const
+        {
+            return failures == 0;
+        }
+        std::size_t size() const
+        {
+            return statements.size();
+        }
+        // the whole program as the sequential parser would give it, throwing
+        // the same error if it doesn't parse
+        ccpp::ast tree() const
+        {
+            if (!valid())
+            {
+                auto source = text();
+                parser(token_stream(input_stream(std::string_view(source)), table)).parse();
+                throw exception("Parser disagrees with itself");
+            }
+            ccpp::ast tree;
+            tree.symbols = table;
+            auto at = tree.reserve(statements | std::views::transform(&statement::tree));
+            std::size_t start = 0;
+            std::size_t count = 0;
+            for (std::size_t i = 0; i < statements.size(); i++)
+            {
+                at[i].source = static_cast<std::uint32_t>(start);
+                tree.place(statements[i].tree, at[i]);
+                start += statements[i].text.size();
+                count += statements[i].roots.size();
+            }
+            tree.root = tree.make<prog_node>(node_kind::prog_t, static_cast<std::uint32_t>(count));
+            tree.get<prog_node>(tree.root).head.span = {0, static_cast<std::uint32_t>(start)};
+            auto items = tree.children<prog_node>(tree.root).begin();
+            for (std::size_t i = 0; i < statements.size(); i++)
+                for (auto root : statements[i].roots)
+                    *items++ = root + at[i].node;
+            return tree;
+        }
+    };
+} // namespace ccpp
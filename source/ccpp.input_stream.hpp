@@ -1,45 +1,170 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 
+#include "ccpp.diagnostics.hpp"
 #include "ccpp.execption.hpp"
+#include "ccpp.line_index.hpp"
+#include "ccpp.mapped_file.hpp"
+#include "ccpp.stream_reader.hpp"
 
 namespace ccpp
 {
+    // borrows the source text, the caller keeps the buffer alive for as long as
+    // the stream (and anything lexed from it) is in use. over a stream_reader
+    // the text is a window that slides along as it is read; offsets stay
+    // counted from the start of the source. the stream only keeps the offset
+    // it is at, lines and cols are worked out when position() is asked
     class input_stream
     {
-        int pos = 0;
-        int line = 1;
-        int col = 0;
-        std::string input;
+        // pos and end index the window, which starts at offset base
+        std::size_t pos = 0;
+        std::size_t end = 0;
+        std::size_t base = 0;
+        // bytes from this offset on are kept when the window slides
+        std::size_t held = static_cast<std::size_t>(-1);
+        std::string_view input;
+        // built on the first position() asked, each copy of the stream has its own
+        mutable ccpp::line_index lines;
+        std::shared_ptr<const ccpp::mapped_file> file;
+        std::shared_ptr<ccpp::stream_reader> reader;
+
+        // the window ran out: drops what is before `keep` and reads on, false
+        // at the end of the source
+        bool refill(std::size_t keep)
+        {
+            if (!reader)
+                return false;
+            auto at = base + pos;
+            // the lines of the text about to be dropped are counted first
+            lines.scan(input, base);
+            bool more = reader->fill(keep);
+            base = reader->start();
+            input = reader->window();
+            pos = at - base;
+            end = input.size();
+            lines.drop(base);
+            return more;
+        }
 
     public:
-        input_stream(std::string input) : input(input) {}
+        input_stream(std::string_view input) : end(input.size()), input(input) {}
+        // takes over a read-only mapping of the file, copies of the stream share it
+        input_stream(ccpp::mapped_file mapped) : file(std::make_shared<const ccpp::mapped_file>(std::move(mapped)))
+        {
+            input = file->view();
+            end = input.size();
+        }
+        // reads the source as it arrives, copies of the stream share the
+        // reader and only one of them may read from it
+        input_stream(ccpp::stream_reader reader) : reader(std::make_shared<ccpp::stream_reader>(std::move(reader))) {}
         char next()
         {
-            char ch = input[pos++];
-            if (ch == '\n')
-            {
-                line++;
-                col = 0;
-            }
-            else
-            {
-                col++;
-            }
-            return ch;
+            if (pos >= end && !refill(std::min(base + pos, held)))
+                return '\0';
+            return input[pos++];
         }
         char peek()
         {
+            if (pos >= end && !refill(std::min(base + pos, held)))
+                return '\0';
             return input[pos];
         }
         bool eof()
         {
-            return peek() == '\0';
+            return pos >= end && !refill(std::min(base + pos, held));
+        }
+        // where the next char is in the source
+        std::size_t offset() const
+        {
+            return base + pos;
+        }
+        std::size_t offset_of(const char *p) const
+        {
+            return base + static_cast<std::size_t>(p - input.data());
+        }
+        // text at `offset` that is still in the window
+        std::string_view slice(std::size_t offset, std::size_t length) const
+        {
+            return input.substr(offset - base, length);
+        }
+        // the text before the cursor is no longer needed, a stream_reader may
+        // drop it. the lexer marks every token it starts, so only the text of
+        // the last one stays
+        void mark()
+        {
+            held = base + pos;
+        }
+        // raw view of the unread part of the window, for scanning a whole run at once
+        const char *cursor() const
+        {
+            return input.data() + pos;
+        }
+        const char *limit() const
+        {
+            return input.data() + end;
+        }
+        // consumes everything up to `to` (a pointer between cursor() and limit())
+        std::string_view take(const char *to)
+        {
+            std::string_view slice(cursor(), static_cast<std::size_t>(to - cursor()));
+            pos += slice.size();
+            return slice;
+        }
+        // consumes the run `kernel(cursor(), limit())` finds, reading on while
+        // it reaches the end of the window. kernels must be able to resume a
+        // run where they stopped
+        template <typename Kernel>
+        std::string_view take_run(Kernel kernel)
+        {
+            auto from = base + pos;
+            take(kernel(cursor(), limit()));
+            while (pos >= end && refill(std::min(from, held)))
+                take(kernel(cursor(), limit()));
+            return slice(from, base + pos - from);
+        }
+        // take_run for text nobody needs (whitespace, comments), which the
+        // window doesn't keep
+        template <typename Kernel>
+        void skip_run(Kernel kernel)
+        {
+            take(kernel(cursor(), limit()));
+            while (pos >= end && refill(base + pos))
+                take(kernel(cursor(), limit()));
+        }
+        // continues reading at `offset`, which needs the whole source in memory
+        void seek(std::size_t offset)
+        {
+            pos = std::min(offset, end);
+        }
+        // line and col of `offset`. over a stream_reader only offsets in the
+        // window can be asked for
+        ccpp::position position(std::size_t offset) const
+        {
+            offset = std::min(offset, base + end);
+            lines.scan(input.substr(0, offset - std::min(offset, base)), base);
+            return lines.locate(offset);
+        }
+        // a problem with `span`, located where the span starts
+        diagnostic diagnose(std::string msg, source_span span, severity level = severity::error) const
+        {
+            auto at = position(span.begin);
+            return {level, span, at.line, at.col, std::move(msg)};
         }
         void croak(std::string msg)
         {
-            throw exception((msg + " (" + std::to_string(line) + ":" + std::to_string(col) + ")"));
+            auto at = static_cast<std::uint32_t>(offset());
+            throw exception(diagnose(std::move(msg), {at, at}).text());
+        }
+        // the whole source, or only the current window over a stream_reader
+        std::string_view source() const
+        {
+            return input;
         }
     };
 } // namespace ccpp
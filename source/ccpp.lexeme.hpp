@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "ccpp.operator.hpp"
+#include "ccpp.symbol_table.hpp"
+
+namespace ccpp
+{
+    enum class lexeme_kind : std::uint8_t
+    {
+        eof,
+        num,  // number
+        str,  // span includes the quotes, escapes are resolved by unescape
+        kw,   // keyword
+        var,  // identifier
+        punc, // ,;(){}[]
+        op,   // operator
+    };
+    inline std::string_view to_string(lexeme_kind kind)
+    {
+        switch (kind)
+        {
+        case lexeme_kind::eof:
+            return "eof";
+        case lexeme_kind::num:
+            return "num";
+        case lexeme_kind::str:
+            return "str";
+        case lexeme_kind::kw:
+            return "kw";
+        case lexeme_kind::var:
+            return "var";
+        case lexeme_kind::punc:
+            return "punc";
+        case lexeme_kind::op:
+            return "op";
+        }
+        return "unknown";
+    }
+
+    // lexical token: a span into the source plus a small payload, no ownership
+    struct lexeme
+    {
+        static constexpr std::uint32_t max_length = (1u << 24) - 1;
+
+        std::uint32_t offset = 0;
+        std::uint32_t length : 24 = 0;
+        lexeme_kind kind : 8 = lexeme_kind::eof;
+        union
+        {
+            double number = 0; // num
+            char ch;           // punc
+            op_kind op;        // op
+            ccpp::symbol name; // var, kw (the keyword id)
+        };
+
+        std::string_view text(std::string_view source) const
+        {
+            return source.substr(offset, length);
+        }
+    };
+    static_assert(sizeof(lexeme) <= 16);
+
+    // resolves backslash escapes of a string lexeme into `str`, the span still
+    // has its quotes. reusing `str` saves an allocation per literal
+    template <typename String>
+    void unescape(std::string_view quoted, String &str)
+    {
+        str.clear();
+        if (quoted.empty())
+            return;
+        const char stops[] = {'\\', quoted.front()};
+        std::string_view body = quoted.substr(1);
+        str.reserve(body.size());
+        while (!body.empty())
+        {
+            auto stop = body.find_first_of(std::string_view(stops, 2));
+            if (stop == std::string_view::npos)
+            {
+                str += body;
+                break;
+            }
+            str += body.substr(0, stop);
+            if (body[stop] != '\\' || stop + 1 == body.size())
+                break;
+            str += body[stop + 1];
+            body.remove_prefix(stop + 2);
+        }
+    }
+    inline std::string unescape(std::string_view quoted)
+    {
+        std::string str;
+        unescape(quoted, str);
+        return str;
+    }
+} // namespace ccpp
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.scan.hpp"
+
+namespace ccpp
+{
+    // 1-based line and the number of bytes before the offset on that line
+    struct position
+    {
+        int line = 1;
+        int col = 0;
+    };
+
+    // where the lines of a source start, so that offsets only become line and
+    // col when someone asks. the source is scanned for newlines as far as the
+    // offsets asked about, and over a stream the lines before the window are
+    // only counted
+    class line_index
+    {
+        // starts[0] is the start of line `first`. empty until the first scan,
+        // so a stream no one asks for a position doesn't allocate for it
+        std::vector<std::size_t> starts;
+        std::size_t first = 1;
+        // the source before this offset has been scanned
+        std::size_t scanned = 0;
+
+    public:
+        // scans what of `text`, which is at offset `at` in the source, is
+        // past the part scanned so far
+        void scan(std::string_view text, std::size_t at)
+        {
+            if (starts.empty())
+                starts.push_back(0);
+            auto end = at + text.size();
+            if (end <= scanned)
+                return;
+            auto from = std::max(scanned, at);
+            ccpp::scan::line_starts(text.data() + (from - at), text.data() + text.size(), from, starts);
+            scanned = end;
+        }
+        // forgets the lines that end before `offset`, which must be scanned
+        void drop(std::size_t offset)
+        {
+            auto line = std::upper_bound(starts.begin() + 1, starts.end(), offset) - 1;
+            first += static_cast<std::size_t>(line - starts.begin());
+            starts.erase(starts.begin(), line);
+        }
+        // the position of `offset`, which must be in the scanned part
+        ccpp::position locate(std::size_t offset) const
+        {
+            offset = std::max(offset, starts.front());
+            auto line = std::upper_bound(starts.begin() + 1, starts.end(), offset) - 1;
+            return {static_cast<int>(first + static_cast<std::size_t>(line - starts.begin())), static_cast<int>(offset - *line)};
+        }
+    };
+} // namespace ccpp
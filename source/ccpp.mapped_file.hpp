@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ccpp.execption.hpp"
+
+namespace ccpp
+{
+    // read-only memory mapping of a whole file, the mapping lives as long as the object.
+    // a copy-on-write mapping may be written to, the changes stay private to it
+    class mapped_file
+    {
+        const char *data_ = nullptr;
+        std::size_t size_ = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+
+    public:
+        explicit mapped_file(const std::filesystem::path &path, bool copy_on_write = false)
+        {
+#ifdef _WIN32
+            file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                throw exception("Can't open file: " + path.string());
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size))
+            {
+                CloseHandle(file);
+                throw exception("Can't stat file: " + path.string());
+            }
+            size_ = static_cast<std::size_t>(size.QuadPart);
+            if (size_ == 0)
+                return;
+            mapping = CreateFileMappingW(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr)
+            {
+                CloseHandle(file);
+                throw exception("Can't map file: " + path.string());
+            }
+            data_ = static_cast<const char *>(MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+            if (data_ == nullptr)
+            {
+                CloseHandle(mapping);
+                CloseHandle(file);
+                throw exception("Can't map file: " + path.string());
+            }
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw exception("Can't open file: " + path.string());
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                throw exception("Can't stat file: " + path.string());
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ != 0)
+            {
+                void *addr = ::mmap(nullptr, size_, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw exception("Can't map file: " + path.string());
+                }
+                ::madvise(addr, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char *>(addr);
+            }
+            ::close(fd);
+#endif
+        }
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+        mapped_file(mapped_file &&other) noexcept
+            : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+#ifdef _WIN32
+              ,
+              file(std::exchange(other.file, INVALID_HANDLE_VALUE)), mapping(std::exchange(other.mapping, nullptr))
+#endif
+        {
+        }
+        ~mapped_file()
+        {
+#ifdef _WIN32
+            if (data_ != nullptr)
+                UnmapViewOfFile(data_);
+            if (mapping != nullptr)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+#else
+            if (data_ != nullptr)
+                ::munmap(const_cast<char *>(data_), size_);
+#endif
+        }
+
+        const char *data() const { return data_; }
+        // only for a copy-on-write mapping
+        char *writable_data() const { return const_cast<char *>(data_); }
+        std::size_t size() const { return size_; }
+        std::string_view view() const { return std::string_view(data_ == nullptr ? "" : data_, size_); }
+    };
+} // namespace ccpp
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ccpp
+{
+    enum class op_kind : std::uint8_t
+    {
+        assign, // =
+        or_,    // ||
+        and_,   // &&
+        lt,     // <
+        gt,     // >
+        le,     // <=
+        ge,     // >=
+        eq,     // ==
+        ne,     // !=
+        add,    // +
+        sub,    // -
+        mul,    // *
+        div,    // /
+        mod,    // %
+    };
+
+    struct op_info
+    {
+        std::string_view text;
+        std::uint8_t precedence;
+        bool right_assoc;
+    };
+
+    // indexed by op_kind
+    inline constexpr std::array<op_info, 14> operators = {{
+        {"=", 1, true},
+        {"||", 2, false},
+        {"&&", 3, false},
+        {"<", 7, false},
+        {">", 7, false},
+        {"<=", 7, false},
+        {">=", 7, false},
+        {"==", 7, false},
+        {"!=", 7, false},
+        {"+", 10, false},
+        {"-", 10, false},
+        {"*", 20, false},
+        {"/", 20, false},
+        {"%", 20, false},
+    }};
+
+    constexpr const op_info &info(op_kind op)
+    {
+        return operators[static_cast<std::size_t>(op)];
+    }
+    constexpr std::string_view to_string(op_kind op)
+    {
+        return info(op).text;
+    }
+
+    // maps operator text to its kind, false for anything not in the table
+    constexpr bool lookup_operator(std::string_view text, op_kind &op)
+    {
+        if (text.size() == 1)
+        {
+            switch (text[0])
+            {
+            case '=':
+                op = op_kind::assign;
+                return true;
+            case '<':
+                op = op_kind::lt;
+                return true;
+            case '>':
+                op = op_kind::gt;
+                return true;
+            case '+':
+                op = op_kind::add;
+                return true;
+            case '-':
+                op = op_kind::sub;
+                return true;
+            case '*':
+                op = op_kind::mul;
+                return true;
+            case '/':
+                op = op_kind::div;
+                return true;
+            case '%':
+                op = op_kind::mod;
+                return true;
+            }
+            return false;
+        }
+        if (text.size() == 2 && text[1] == '=')
+        {
+            switch (text[0])
+            {
+            case '<':
+                op = op_kind::le;
+                return true;
+            case '>':
+                op = op_kind::ge;
+                return true;
+            case '=':
+                op = op_kind::eq;
+                return true;
+            case '!':
+                op = op_kind::ne;
+                return true;
+            }
+            return false;
+        }
+        if (text == "||")
+        {
+            op = op_kind::or_;
+            return true;
+        }
+        if (text == "&&")
+        {
+            op = op_kind::and_;
+            return true;
+        }
+        return false;
+    }
+} // namespace ccpp
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.builtins.hpp"
+#include "ccpp.value.hpp"
+
+namespace ccpp
+{
+    // rewrites an unresolved ast into a fresh arena: folds operators over
+    // literals, drops identities that can't change the result, prunes if/&&/||
+    // on literal conditions and splices nested progs into their parent
+    class optimizer
+    {
+        const ccpp::ast &tree;
+        // the arena being read, the parse or the first pass
+        const ccpp::ast *in = nullptr;
+        ccpp::ast out;
+
+        bool literal(node_id id) const
+        {
+            auto kind = out.kind(id);
+            return kind == node_kind::num_t || kind == node_kind::str_t || kind == node_kind::bool_t;
+        }
+        // no side effects and no way to fail, so the value can be dropped
+        bool pure(node_id id) const
+        {
+            return literal(id) || out.kind(id) == node_kind::lambda_t;
+        }
+        value constant(node_id id) const
+        {
+            switch (out.kind(id))
+            {
+            case node_kind::num_t:
+                return value::number(out.get<num_node>(id).value);
+            case node_kind::str_t:
+                return value::string(std::string(out.text(out.get<str_node>(id).value)));
+            default:
+                return out.get<bool_node>(id).value;
+            }
+        }
+        bool is_number(node_id id, double n) const
+        {
+            return out.kind(id) == node_kind::num_t && out.get<num_node>(id).value == n;
+        }
+        // always a number at runtime (or an error), never a string
+        bool numeric(node_id id) const
+        {
+            if (out.kind(id) == node_kind::num_t)
+                return true;
+            if (out.kind(id) != node_kind::binary_t)
+                return false;
+            auto &n = out.get<binary_node>(id);
+            switch (static_cast<op_kind>(n.head.op))
+            {
+            case op_kind::add:
+                return numeric(n.left) && numeric(n.right);
+            case op_kind::sub:
+            case op_kind::mul:
+            case op_kind::div:
+            case op_kind::mod:
+                return true;
+            default:
+                return false;
+            }
+        }
+        // a number that can't be -0, for which x + 0 is x
+        bool integral(node_id id) const
+        {
+            if (out.kind(id) == node_kind::num_t)
+                return value::number(out.get<num_node>(id).value).is_int();
+            if (out.kind(id) != node_kind::binary_t)
+                return false;
+            auto &n = out.get<binary_node>(id);
+            switch (static_cast<op_kind>(n.head.op))
+            {
+            case op_kind::add:
+            case op_kind::sub:
+            case op_kind::mul:
+                return integral(n.left) && integral(n.right);
+            default:
+                return false;
+            }
+        }
+
+        // the nodes made below take the span of the node they replace, so
+        // errors in an optimized tree still point at the source
+        node_id make_bool(bool v, source_span span)
+        {
+            auto id = out.make<bool_node>(node_kind::bool_t);
+            out.get<bool_node>(id).value = v;
+            out.get<bool_node>(id).head.span = span;
+            return id;
+        }
+        node_id make_constant(const value &v, source_span span)
+        {
+            if (v.is_bool())
+                return make_bool(v.as_bool(), span);
+            if (v.is_string())
+            {
+                auto ref = out.intern_text(v.as_string());
+                auto id = out.make<str_node>(node_kind::str_t);
+                out.get<str_node>(id).value = ref;
+                out.get<str_node>(id).head.span = span;
+                return id;
+            }
+            auto id = out.make<num_node>(node_kind::num_t);
+            out.get<num_node>(id).value = v.as_number();
+            out.get<num_node>(id).head.span = span;
+            return id;
+        }
+        template <typename Node>
+        node_id make_list(node_kind kind, const std::vector<node_id> &items, source_span span)
+        {
+            auto id = out.make<Node>(kind, static_cast<std::uint32_t>(items.size()));
+            out.get<Node>(id).head.span = span;
+            auto children = out.children<Node>(id);
+            std::copy(items.begin(), items.end(), children.begin());
+            return id;
+        }
+        node_id make_binary(node_kind kind, const node &from, node_id left, node_id right)
+        {
+            auto id = out.make<binary_node>(kind);
+            auto &n = out.get<binary_node>(id);
+            n.head.op = from.op;
+            n.head.span = from.span;
+            n.left = left;
+            n.right = right;
+            return id;
+        }
+
+        node_id fold_binary(const binary_node &n)
+        {
+            auto op = static_cast<op_kind>(n.head.op);
+            auto left = fold(n.left);
+            if (op == op_kind::and_ && literal(left))
+                return constant(left).truthy() ? fold(n.right) : make_bool(false, n.head.span);
+            if (op == op_kind::or_ && literal(left))
+                return constant(left).truthy() ? make_bool(true, n.head.span) : fold(n.right);
+            auto right = fold(n.right);
+            if (literal(left) && literal(right) && op != op_kind::and_ && op != op_kind::or_)
+            {
+                try
+                {
+                    return make_constant(apply_op(op, constant(left), constant(right)), n.head.span);
+                }
+                catch (const exception &)
+                {
+                    // leave the error to runtime
+                }
+            }
+            switch (op)
+            {
+            case op_kind::add:
+                if (is_number(right, 0) && integral(left))
+                    return left;
+                if (is_number(left, 0) && integral(right))
+                    return right;
+                break;
+            case op_kind::sub:
+                if (is_number(right, 0) && numeric(left))
+                    return left;
+                break;
+            case op_kind::mul:
+                if (is_number(right, 1) && numeric(left))
+                    return left;
+                if (is_number(left, 1) && numeric(right))
+                    return right;
+                break;
+            default:
+                break;
+            }
+            return make_binary(node_kind::binary_t, n.head, left, right);
+        }
+        // appends the items of a prog, splicing nested progs in place
+        void fold_items(node_id id, std::vector<node_id> &items)
+        {
+            for (auto item : in->children<prog_node>(id))
+            {
+                if (in->kind(item) == node_kind::prog_t)
+                {
+                    fold_items(item, items);
+                    continue;
+                }
+                if (!items.empty() && pure(items.back()))
+                    items.pop_back();
+                items.push_back(fold(item));
+            }
+        }
+
+        node_id fold(node_id id)
+        {
+            if (id == no_node)
+                return no_node;
+            switch (in->kind(id))
+            {
+            case node_kind::num_t:
+            case node_kind::str_t:
+            case node_kind::bool_t:
+                return make_constant(literal_value(id), in->at(id).span);
+            case node_kind::var_t:
+            {
+                auto copy = out.make<var_node>(node_kind::var_t);
+                out.get<var_node>(copy) = in->get<var_node>(id);
+                return copy;
+            }
+            case node_kind::assign_t:
+            {
+                auto &n = in->get<binary_node>(id);
+                auto left = fold(n.left);
+                auto right = fold(n.right);
+                return make_binary(node_kind::assign_t, n.head, left, right);
+            }
+            case node_kind::binary_t:
+                return fold_binary(in->get<binary_node>(id));
+            case node_kind::call_t:
+            {
+                std::vector<node_id> items{fold(in->get<call_node>(id).func)};
+                for (auto arg : in->children<call_node>(id))
+                    items.push_back(fold(arg));
+                auto call = out.make<call_node>(node_kind::call_t, static_cast<std::uint32_t>(items.size() - 1));
+                out.get<call_node>(call).func = items[0];
+                out.get<call_node>(call).head.span = in->at(id).span;
+                auto args = out.children<call_node>(call);
+                std::copy(items.begin() + 1, items.end(), args.begin());
+                return call;
+            }
+            case node_kind::if_t:
+            {
+                auto &n = in->get<if_node>(id);
+                auto cond = fold(n.cond);
+                if (literal(cond))
+                {
+                    auto taken = constant(cond).truthy() ? n.then : n.else_;
+                    return taken != no_node ? fold(taken) : make_bool(false, n.head.span);
+                }
+                auto then = fold(n.then);
+                auto else_ = fold(n.else_);
+                auto copy = out.make<if_node>(node_kind::if_t);
+                auto &c = out.get<if_node>(copy);
+                c.head.span = n.head.span;
+                c.cond = cond;
+                c.then = then;
+                c.else_ = else_;
+                return copy;
+            }
+            case node_kind::lambda_t:
+            {
+                std::vector<node_id> vars;
+                for (auto var : in->children<lambda_node>(id))
+                    vars.push_back(fold(var));
+                auto body = fold(in->get<lambda_node>(id).body);
+                auto copy = make_list<lambda_node>(node_kind::lambda_t, vars, in->at(id).span);
+                out.get<lambda_node>(copy).body = body;
+                return copy;
+            }
+            case node_kind::prog_t:
+            {
+                std::vector<node_id> items;
+                fold_items(id, items);
+                if (items.empty())
+                    return make_bool(false, in->at(id).span);
+                if (items.size() == 1)
+                    return items[0];
+                return make_list<prog_node>(node_kind::prog_t, items, in->at(id).span);
+            }
+            }
+            throw exception("Can't optimize " + std::string(to_string(in->kind(id))));
+        }
+        value literal_value(node_id id) const
+        {
+            switch (in->kind(id))
+            {
+            case node_kind::num_t:
+                return value::number(in->get<num_node>(id).value);
+            case node_kind::str_t:
+                return value::string(std::string(in->text(in->get<str_node>(id).value)));
+            default:
+                return in->get<bool_node>(id).value;
+            }
+        }
+
+        ccpp::ast pass(const ccpp::ast &from)
+        {
+            in = &from;
+            out = ccpp::ast();
+            out.symbols = from.symbols;
+            out.root = fold(from.root);
+            return std::move(out);
+        }
+
+    public:
+        optimizer(const ccpp::ast &tree) : tree(tree) {}
+        // folded literals leave their operands behind in the first arena, the
+        // second pass finds nothing left to fold and copies only what survived
+        ccpp::ast optimize()
+        {
+            auto first = pass(tree);
+            return pass(first);
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.input_stream.hpp"
+#include "ccpp.lexeme.hpp"
+#include "ccpp.scan.hpp"
+#include "ccpp.symbol_table.hpp"
+#include "ccpp.thread_pool.hpp"
+#include "ccpp.token_stream.hpp"
+
+namespace ccpp
+{
+    // lexes a whole source into one flat token array, identical to draining a
+    // token_stream, by lexing newline-aligned chunks in parallel. each chunk
+    // guesses that it starts between tokens; the merge walks the chunks in
+    // order and relexes the start of any chunk whose guess was wrong (a string
+    // running over the boundary) until it lines up with the guessed tokens
+    class parallel_lexer
+    {
+        static constexpr symbol no_symbol = static_cast<symbol>(-1);
+
+        struct chunk
+        {
+            std::size_t begin = 0;
+            std::size_t limit = 0;
+            // tokens starting in [begin, limit) as lexed from begin
+            std::vector<lexeme> tokens;
+            // where the first token after the chunk starts
+            std::size_t next = 0;
+            // lexing stopped at an error after the last token
+            bool failed = false;
+            // names of the var tokens, mapped to the shared table in the merge
+            std::unique_ptr<ccpp::symbol_table> symbols = std::make_unique<ccpp::symbol_table>();
+
+            // filled by the merge: tokens relexed from the true start of the
+            // chunk, then tokens[from..] which lined up with them
+            std::vector<lexeme> head;
+            std::size_t from = 0;
+            // local names in first-seen order and their ids in the shared table
+            std::vector<symbol> order;
+            std::vector<symbol> remap;
+        };
+
+        ccpp::input_stream input;
+        std::shared_ptr<ccpp::symbol_table> table;
+        ccpp::thread_pool &pool;
+
+        // appends tokens from `from` until one starts at or after `limit`,
+        // or (when `sync` is given) at an offset where `sync` has a token too.
+        // returns where lexing stopped and the index of the sync token
+        std::pair<std::size_t, std::size_t> lex(std::size_t from, std::size_t limit, ccpp::symbol_table *symbols,
+                                                std::vector<lexeme> &out, const std::vector<lexeme> *sync = nullptr)
+        {
+            auto is = input;
+            is.seek(from);
+            // the stream interns into `symbols` without owning it
+            token_stream ts(is, std::shared_ptr<ccpp::symbol_table>(std::shared_ptr<void>(), symbols));
+            std::size_t at = 0;
+            for (;;)
+            {
+                auto tok = ts.next();
+                if (tok.kind == lexeme_kind::eof || tok.offset >= limit)
+                    return {tok.kind == lexeme_kind::eof ? input.source().size() : tok.offset, no_sync};
+                if (sync != nullptr)
+                {
+                    while (at < sync->size() && (*sync)[at].offset < tok.offset)
+                        at++;
+                    if (at < sync->size() && (*sync)[at].offset == tok.offset)
+                        return {tok.offset, at};
+                }
+                out.push_back(tok);
+            }
+        }
+        void lex_chunk(chunk &c)
+        {
+            try
+            {
+                c.next = lex(c.begin, c.limit, c.symbols.get(), c.tokens).first;
+            }
+            catch (const exception &)
+            {
+                c.failed = true;
+            }
+        }
+        // the sequential lexer raises the error with the right position
+        [[noreturn]] void fail()
+        {
+            token_stream ts(input, table);
+            while (!ts.eof())
+                ts.next();
+            throw exception("Lexer disagrees with itself");
+        }
+
+    public:
+        static constexpr std::size_t no_sync = static_cast<std::size_t>(-1);
+        // chunks are at least this large, smaller sources are lexed in one piece
+        std::size_t min_chunk = 1 << 18;
+
+        parallel_lexer(ccpp::input_stream input, std::shared_ptr<ccpp::symbol_table> symbols = std::make_shared<ccpp::symbol_table>(),
+                       ccpp::thread_pool &pool = ccpp::thread_pool::shared())
+            : input(std::move(input)), table(std::move(symbols)), pool(pool) {}
+
+        const std::shared_ptr<ccpp::symbol_table> &symbols() const
+        {
+            return table;
+        }
+
+        // every token of the source, ending with the eof token
+        std::vector<lexeme> lex()
+        {
+            auto source = input.source();
+            auto size = source.size();
+            auto target = std::max(min_chunk, size / (pool.size() * 4 + 1));
+            std::vector<chunk> chunks;
+            for (std::size_t begin = 0; begin < size || chunks.empty();)
+            {
+                auto cut = std::min(size, begin + target);
+                if (cut < size)
+                    cut = static_cast<std::size_t>(scan::find(source.data() + cut, source.data() + size, '\n') - source.data());
+                cut = std::min(size, cut + 1);
+                auto &c = chunks.emplace_back();
+                c.begin = begin;
+                c.limit = cut;
+                begin = cut;
+            }
+            chunks.back().limit = size + 1;
+            pool.run(chunks.size(), [&](std::size_t i)
+                     { lex_chunk(chunks[i]); });
+
+            // where the true token sequence continues. deciding which tokens
+            // survive is sequential but only relexes what was guessed wrong
+            std::size_t next = 0;
+            for (auto &c : chunks)
+            {
+                c.from = c.tokens.size();
+                if (!c.tokens.empty() && c.tokens.front().offset == next)
+                    c.from = 0;
+                else if (next < c.limit)
+                {
+                    try
+                    {
+                        auto [stop, at] = lex(next, c.limit, c.symbols.get(), c.head, &c.tokens);
+                        next = stop;
+                        if (at != no_sync)
+                            c.from = at;
+                    }
+                    catch (const exception &)
+                    {
+                        fail();
+                    }
+                }
+                if (c.from < c.tokens.size())
+                {
+                    if (c.failed)
+                        fail();
+                    next = c.next;
+                }
+            }
+
+            // names are interned in first-seen order, so ids match the
+            // sequential lexer; only the distinct names of a chunk are serial
+            pool.run(chunks.size(), [&](std::size_t i)
+                     {
+                auto &c = chunks[i];
+                std::vector<bool> seen(c.symbols->size());
+                auto visit = [&](const lexeme &tok)
+                {
+                    if (tok.kind == lexeme_kind::var && !seen[tok.name])
+                    {
+                        seen[tok.name] = true;
+                        c.order.push_back(tok.name);
+                    }
+                };
+                for (auto &tok : c.head)
+                    visit(tok);
+                for (auto j = c.from; j < c.tokens.size(); j++)
+                    visit(c.tokens[j]); });
+            std::vector<std::size_t> offsets(chunks.size() + 1);
+            for (std::size_t i = 0; i < chunks.size(); i++)
+            {
+                auto &c = chunks[i];
+                c.remap.assign(c.symbols->size(), no_symbol);
+                for (auto id : c.order)
+                    c.remap[id] = table->intern(c.symbols->name(id));
+                offsets[i + 1] = offsets[i] + c.head.size() + (c.tokens.size() - c.from);
+            }
+
+            std::vector<lexeme> tokens(offsets.back() + 1);
+            pool.run(chunks.size(), [&](std::size_t i)
+                     {
+                auto &c = chunks[i];
+                auto out = tokens.begin() + static_cast<std::ptrdiff_t>(offsets[i]);
+                auto copy = [&](lexeme tok)
+                {
+                    if (tok.kind == lexeme_kind::var)
+                        tok.name = c.remap[tok.name];
+                    *out++ = tok;
+                };
+                for (auto &tok : c.head)
+                    copy(tok);
+                for (auto j = c.from; j < c.tokens.size(); j++)
+                    copy(c.tokens[j]);
+                c.tokens = std::vector<lexeme>(); });
+            auto &eof = tokens.back();
+            eof.kind = lexeme_kind::eof;
+            eof.offset = static_cast<std::uint32_t>(size);
+            eof.length = 0;
+            return tokens;
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+#include "ccpp.input_stream.hpp"
+#include "ccpp.lexeme.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.symbol_table.hpp"
+#include "ccpp.thread_pool.hpp"
+#include "ccpp.token_stream.hpp"
+
+namespace ccpp
+{
+    // parses a pre-lexed token array into the same ast as the sequential
+    // parser. the toplevel is cut at `;` outside brackets into runs of whole
+    // statements, each run is parsed into an arena of its own on the pool, and
+    // the arenas are joined back in source order under the toplevel prog node
+    class parallel_parser
+    {
+        // statements in tokens [begin, end), tokens[end] is the `;` or eof after them
+        struct batch
+        {
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            ccpp::ast tree{};
+            std::vector<node_id> roots{};
+            bool failed = false;
+        };
+
+        ccpp::input_stream input;
+        std::vector<lexeme> tokens;
+        std::shared_ptr<ccpp::symbol_table> table;
+        ccpp::thread_pool &pool;
+
+        std::vector<batch> split() const
+        {
+            auto target = std::max(min_batch, tokens.size() / (pool.size() * 8 + 1));
+            std::vector<batch> batches;
+            std::size_t begin = 0;
+            int depth = 0;
+            for (std::size_t i = 0; i < tokens.size(); i++)
+            {
+                auto &tok = tokens[i];
+                if (tok.kind == lexeme_kind::eof)
+                {
+                    // a trailing `;` ends the program without an empty statement
+                    if (i > begin)
+                        batches.push_back({begin, i});
+                    break;
+                }
+                if (tok.kind != lexeme_kind::punc)
+                    continue;
+                if (tok.ch == '(' || tok.ch == '{' || tok.ch == '[')
+                    depth++;
+                else if (tok.ch == ')' || tok.ch == '}' || tok.ch == ']')
+                    depth--;
+                else if (tok.ch == ';' && depth == 0 && i - begin >= target)
+                {
+                    batches.push_back({begin, i});
+                    begin = i + 1;
+                }
+            }
+            return batches;
+        }
+        void parse(batch &b) const
+        {
+            std::span<const lexeme> slice(tokens.data() + b.begin, b.end - b.begin);
+            try
+            {
+                b.tree = parser(token_stream(input, slice, tokens[b.end].offset, table)).parse_statements(b.roots);
+            }
+            catch (const exception &)
+            {
+                b.failed = true;
+            }
+        }
+        // the sequential parser raises the error with the right message and
+        // position. everything before `b` parsed, so it resumes from there
+        [[noreturn]] void fail(const batch &b) const
+        {
+            std::span<const lexeme> rest(tokens.data() + b.begin, tokens.size() - 1 - b.begin);
+            parser(token_stream(input, rest, tokens.back().offset, table)).parse();
+            throw exception("Parser disagrees with itself");
+        }
+
+    public:
+        // runs are at least this many tokens, smaller programs are parsed in one piece
+        std::size_t min_batch = 1 << 12;
+
+        // `tokens` end with the eof token, as parallel_lexer::lex() returns them
+        parallel_parser(ccpp::input_stream input, std::vector<lexeme> tokens, std::shared_ptr<ccpp::symbol_table> symbols,
+                        ccpp::thread_pool &pool = ccpp::thread_pool::shared())
+            : input(std::move(input)), tokens(std::move(tokens)), table(std::move(symbols)), pool(pool) {}
+
+        ccpp::ast parse()
+        {
+            auto batches = split();
+            // runs after one that failed can't change the error
+            std::atomic<std::size_t> failed{batches.size()};
+            pool.run(batches.size(), [&](std::size_t i)
+                     {
+                if (i > failed.load(std::memory_order_relaxed))
+                    return;
+                parse(batches[i]);
+                if (batches[i].failed)
+                    for (auto seen = failed.load(); i < seen && !failed.compare_exchange_weak(seen, i);)
+                        ; });
+            if (failed < batches.size())
+                fail(batches[failed]);
+
+            std::vector<ccpp::ast> parts;
+            parts.reserve(batches.size());
+            std::size_t count = 0;
+            for (auto &b : batches)
+            {
+                parts.push_back(std::move(b.tree));
+                count += b.roots.size();
+            }
+            ccpp::ast tree;
+            tree.symbols = table;
+            auto at = tree.reserve(parts);
+            pool.run(parts.size(), [&](std::size_t i)
+                     { tree.place(parts[i], at[i]); });
+            tree.root = tree.make<prog_node>(node_kind::prog_t, static_cast<std::uint32_t>(count));
+            tree.get<prog_node>(tree.root).head.span = {0, tokens.back().offset};
+            auto items = tree.children<prog_node>(tree.root).begin();
+            for (std::size_t i = 0; i < batches.size(); i++)
+                for (auto root : batches[i].roots)
+                    *items++ = root + at[i].node;
+            return tree;
+        }
+    };
+} // namespace ccpp
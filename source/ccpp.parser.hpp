@@ -1,36 +1,109 @@
 #pragma once
 
-#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <span>
+#include <vector>
 
+#include "ccpp.ast.hpp"
 #include "ccpp.token_stream.hpp"
 
 namespace ccpp
 {
 
+    // trees, their strings and the lists gathered while parsing come from the
+    // memory resource the parser is given, by default the token stream's
     class parser
     {
-        std::map<std::string, int> precedence = {
-            {"=", 1},
-            {"||", 2},
-            {"&&", 3},
-            {"<", 7},
-            {">", 7},
-            {"<=", 7},
-            {">=", 7},
-            {"==", 7},
-            {"!=", 7},
-            {"+", 10},
-            {"-", 10},
-            {"*", 20},
-            {"/", 20},
-            {"%", 20}};
         ccpp::token_stream ts;
+        std::pmr::memory_resource *memory;
+        ccpp::ast tree;
+        // unescaped string literals on their way into the tree
+        std::pmr::string scratch;
+        // atoms being parsed inside each other and operators chained onto
+        // them, which together bound the depth of the tree
+        std::size_t nesting = 0;
+
+        // a level of nesting, given back when it goes out of scope
+        struct level
+        {
+            std::size_t &nesting;
+            std::size_t count = 1;
+
+            ~level() { nesting -= count; }
+        };
+
+        void start()
+        {
+            tree = ccpp::ast(memory);
+            tree.symbols = ts.symbols();
+            ts.diagnostics = diagnostics;
+        }
 
     public:
-        parser(ccpp::token_stream ts) : ts(ts) {}
-        auto parse(ccpp::token_stream ts)
+        // a `{}` block: the node parse_prog made for it, the source it covers
+        // and the nodes [first, last) and strings made while parsing it
+        struct block
         {
-            return parse_toplevel(ts);
+            source_span span;
+            node_id node = no_node;
+            node_id first = 0;
+            node_id last = 0;
+            text_ref text;
+        };
+        // when set, every block parsed is recorded here
+        std::vector<block> *blocks = nullptr;
+        // when set, offered each block before it is parsed. returns a copy in
+        // `tree` of an identical block seen before and sets `end` to where that
+        // block ends, or returns no_node to have it parsed
+        std::function<node_id(ccpp::ast &tree, std::size_t begin, std::size_t &end)> reuse;
+        // when set, errors are reported here and parsing resumes after the
+        // statement each is in, so one pass finds all of them. else the first
+        // one is thrown
+        ccpp::diagnostics *diagnostics = nullptr;
+        // deeper nesting is an error instead of overflowing the native stack,
+        // here or in the passes that walk the tree after. a chain of binary
+        // operators counts a level per operator, so no tree is deeper than
+        // about twice this
+        std::size_t max_depth = 1 << 12;
+
+        parser(ccpp::token_stream ts) : ts(std::move(ts)), memory(this->ts.resource()), tree(memory), scratch(memory) {}
+        parser(ccpp::token_stream ts, std::pmr::memory_resource *memory) : ts(std::move(ts)), memory(memory), tree(memory), scratch(memory) {}
+        ccpp::ast parse()
+        {
+            start();
+            tree.root = parse_toplevel();
+            return std::move(tree);
+        }
+        // the toplevel statements without the prog node around them, `roots`
+        // gets their ids in order and the returned tree has no root
+        ccpp::ast parse_statements(std::vector<node_id> &roots)
+        {
+            start();
+            auto items = parse_items();
+            roots.assign(items.begin(), items.end());
+            return std::move(tree);
+        }
+        // the next toplevel statement in a tree of its own, with it as the
+        // root, or a tree without a root at the end of the input. reads no
+        // further than the `;` after it, so a script can be parsed a statement
+        // at a time while it is still arriving. statements with errors are
+        // skipped when there are diagnostics
+        ccpp::ast parse_next()
+        {
+            start();
+            while (!ts.eof())
+            {
+                if (auto item = parse_statement())
+                {
+                    tree.root = *item;
+                    break;
+                }
+                recover();
+            }
+            return std::move(tree);
         }
 
         /*
@@ -48,59 +121,142 @@ namespace ccpp
          }
          function skip_punc(ch) {
              if (is_punc(ch)) input.next();
-             else input.croak("Expecting punctuation: \"" + ch + "\"");
+             else input.croak("Expecting punctuation: \"" + std::string(ch) + "\"");
          }
          function skip_kw(kw) {
              if (is_kw(kw)) input.next();
-             else input.croak("Expecting keyword: \"" + kw + "\"");
+             else input.croak("Expecting keyword: \"" + std::string(kw) + "\"");
          }
          function skip_op(op) {
              if (is_op(op)) input.next();
-             else input.croak("Expecting operator: \"" + op + "\"");
+             else input.croak("Expecting operator: \"" + std::string(op) + "\"");
          }
          function unexpected() {
              input.croak("Unexpected token: " + JSON.stringify(input.peek()));
          }
          */
-        bool is_punc(std::string ch, ccpp::token_stream ts)
+        bool is_punc(std::string_view ch)
         {
             auto tok = ts.peek();
-            return tok->type == "punc" && (ch.empty() || std::holds_alternative<std::string>(tok->value) || std::get<std::string>(tok->value) == ch);
+            return tok.kind == lexeme_kind::punc && (ch.empty() || ts.text(tok) == ch);
         }
-        bool is_kw(std::string kw, ccpp::token_stream ts)
+        bool is_kw(keyword kw)
         {
             auto tok = ts.peek();
-            return tok->type == "kw" && (kw.empty() || std::holds_alternative<std::string>(tok->value) || std::get<std::string>(tok->value) == kw);
+            return tok.kind == lexeme_kind::kw && tok.name == static_cast<symbol>(kw);
         }
-        bool is_op(std::string op, ccpp::token_stream ts)
+        bool is_op(std::string_view op)
         {
             auto tok = ts.peek();
-            return tok->type == "op" && (op.empty() || std::holds_alternative<std::string>(tok->value) || std::get<std::string>(tok->value) == op);
+            return tok.kind == lexeme_kind::op && (op.empty() || ts.text(tok) == op);
         }
-        void skip_punc(std::string ch, ccpp::token_stream ts)
+        // reports a problem with the next token
+        CCPP_COLD failure fail(std::string msg)
         {
-            if (is_punc(ch, ts))
-                ts.next();
-            else
-                ts.croak("Expecting punctuation: \"" + ch + "\"");
+            auto tok = ts.peek();
+            return ts.fail(std::move(msg), {tok.offset, tok.offset + tok.length});
         }
-        void skip_kw(std::string kw, ccpp::token_stream ts)
+        result<void> skip_punc(std::string_view ch)
         {
-            if (is_kw(kw, ts))
-                ts.next();
-            else
-                ts.croak("Expecting keyword: \"" + kw + "\"");
+            if (!is_punc(ch))
+                return std::unexpected(fail("Expecting punctuation: \"" + std::string(ch) + "\""));
+            ts.next();
+            return {};
+        }
+        result<void> skip_kw(keyword kw)
+        {
+            if (!is_kw(kw))
+                return std::unexpected(fail("Expecting keyword: \"" + std::string(keyword_names[static_cast<symbol>(kw)]) + "\""));
+            ts.next();
+            return {};
+        }
+        result<void> skip_op(std::string_view op)
+        {
+            if (!is_op(op))
+                return std::unexpected(fail("Expecting operator: \"" + std::string(op) + "\""));
+            ts.next();
+            return {};
+        }
+        CCPP_COLD failure too_deep()
+        {
+            return fail("Expression nested too deeply");
+        }
+        CCPP_COLD failure unexpected()
+        {
+            auto tok = ts.peek();
+            if (tok.kind == lexeme_kind::eof)
+                return fail("Unexpected end of input");
+            return fail("Unexpected token: " + std::string(to_string(tok.kind)) + " \"" + std::string(ts.text(tok)) + "\"");
         }
-        void skip_op(std::string op, ccpp::token_stream ts)
+        // after an error: skips to the `;` ending the statement it is in or
+        // the `}` closing the block around that, and stops in front of it
+        void synchronize()
         {
-            if (is_op(op, ts))
+            int depth = 0;
+            for (auto tok = ts.peek(); tok.kind != lexeme_kind::eof; tok = ts.peek())
+            {
+                if (tok.kind == lexeme_kind::punc)
+                {
+                    if (depth == 0 && (tok.ch == ';' || tok.ch == '}'))
+                        return;
+                    if (tok.ch == '(' || tok.ch == '{' || tok.ch == '[')
+                        depth++;
+                    else if ((tok.ch == ')' || tok.ch == '}' || tok.ch == ']') && depth > 0)
+                        depth--;
+                }
                 ts.next();
-            else
-                ts.croak("Expecting operator: \"" + op + "\"");
+            }
+        }
+        // records the source of a node parsed from `begin` up to the last token taken
+        node_id mark(node_id id, std::size_t begin)
+        {
+            tree.get<node>(id).span = {static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(ts.consumed())};
+            return id;
+        }
+        std::size_t begin_of(node_id id) const
+        {
+            return tree.at(id).span.begin;
         }
-        void unexpected(ccpp::token_stream ts)
+        // turns a var/num/str lexeme into an AST leaf
+        node_id make_atom(lexeme tok)
         {
-            ts.croak("Unexpected token: " + ts.peek()->type);
+            auto text = ts.text(tok);
+            switch (tok.kind)
+            {
+            case lexeme_kind::num:
+            {
+                auto id = tree.make<num_node>(node_kind::num_t);
+                tree.get<num_node>(id).value = tok.number;
+                return mark(id, tok.offset);
+            }
+            case lexeme_kind::str:
+            {
+                unescape(text, scratch);
+                auto value = tree.intern_text(scratch);
+                auto id = tree.make<str_node>(node_kind::str_t);
+                tree.get<str_node>(id).value = value;
+                return mark(id, tok.offset);
+            }
+            default:
+            {
+                auto id = tree.make<var_node>(node_kind::var_t);
+                tree.get<var_node>(id).name = tok.name;
+                return mark(id, tok.offset);
+            }
+            }
+        }
+        node_id make_bool(bool value)
+        {
+            auto id = tree.make<bool_node>(node_kind::bool_t);
+            tree.get<bool_node>(id).value = value;
+            return id;
+        }
+        template <typename Node>
+        node_id make_list(node_kind kind, std::span<const node_id> items)
+        {
+            auto id = tree.make<Node>(kind, static_cast<std::uint32_t>(items.size()));
+            std::copy(items.begin(), items.end(), tree.children<Node>(id).begin());
+            return id;
         }
         /*
          function maybe_binary(left, my_prec) {
@@ -119,23 +275,33 @@ namespace ccpp
              }
              return left;
          }*/
-        std::shared_ptr<ccpp::token> maybe_binary(std::shared_ptr<ccpp::token> left, int my_prec, ccpp::token_stream ts)
+        // precedence climbing over the operator table: binds every operator that is
+        // tighter than my_prec, right-associative ones recurse at the same level
+        result<node_id> maybe_binary(node_id left, int my_prec)
         {
-            if (is_op("", ts))
+            level chain{nesting, 0};
+            for (auto tok = ts.peek(); tok.kind == lexeme_kind::op; tok = ts.peek())
             {
-                auto tok = ts.peek();
-                auto his_prec = precedence[std::get<std::string>(tok->value)];
-                if (his_prec > my_prec)
-                {
-                    ts.next();
-                    auto right = maybe_binary(parse_atom(ts), his_prec, ts);
-                    auto tok = std::make_shared<ccpp::token>();
-                    tok->type = std::get<std::string>(tok->value) == "=" ? "assign" : "binary";
-                    tok->operator_ = std::get<std::string>(tok->value);
-                    tok->left = left;
-                    tok->right = right;
-                    return maybe_binary(tok, my_prec, ts);
-                }
+                auto &op = info(tok.op);
+                if (op.precedence <= my_prec)
+                    break;
+                if (nesting >= max_depth)
+                    return std::unexpected(too_deep());
+                nesting++;
+                chain.count++;
+                ts.next();
+                auto atom = parse_atom();
+                if (!atom)
+                    return atom;
+                auto right = maybe_binary(*atom, op.right_assoc ? op.precedence - 1 : op.precedence);
+                if (!right)
+                    return right;
+                auto id = tree.make<binary_node>(tok.op == op_kind::assign ? node_kind::assign_t : node_kind::binary_t);
+                auto &bin = tree.get<binary_node>(id);
+                bin.head.op = static_cast<std::uint8_t>(tok.op);
+                bin.left = left;
+                bin.right = *right;
+                left = mark(id, begin_of(left));
             }
             return left;
         }
@@ -153,24 +319,41 @@ namespace ccpp
             return a;
         }
         */
-        auto delimited(std::string start, std::string stop, std::string separator, std::function<std::shared_ptr<ccpp::token>(ccpp::token_stream)> parser, ccpp::token_stream ts)
+        // the statements of a block recover from errors on their own, other
+        // lists give up on the first one
+        template <typename Parser>
+        result<std::pmr::vector<node_id>> delimited(std::string_view start, std::string_view stop, std::string_view separator, Parser parser)
         {
-            std::vector<std::shared_ptr<ccpp::token>> a;
+            std::pmr::vector<node_id> a(memory);
             bool first = true;
-            skip_punc(start, ts);
+            bool block = diagnostics != nullptr && separator == ";";
+            if (auto opened = skip_punc(start); !opened)
+                return std::unexpected(opened.error());
             while (!ts.eof())
             {
-                if (is_punc(stop, ts))
+                if (is_punc(stop))
                     break;
                 if (first)
                     first = false;
-                else
-                    skip_punc(separator, ts);
-                if (is_punc(stop, ts))
+                else if (auto separated = skip_punc(separator); !separated)
+                {
+                    if (!block)
+                        return std::unexpected(separated.error());
+                    synchronize();
+                    continue;
+                }
+                if (is_punc(stop))
                     break;
-                a.push_back(parser(ts));
+                auto item = parser();
+                if (item)
+                    a.push_back(*item);
+                else if (!block)
+                    return std::unexpected(item.error());
+                else
+                    synchronize();
             }
-            skip_punc(stop, ts);
+            if (auto closed = skip_punc(stop); !closed)
+                return std::unexpected(closed.error());
             return a;
         }
         /*
@@ -187,27 +370,27 @@ namespace ccpp
              return name.value;
          }
          */
-        auto parse_call(std::shared_ptr<ccpp::token> func, ccpp::token_stream ts)
+        result<node_id> parse_call(node_id func)
         {
-            auto call = std::make_shared<ccpp::token>();
-            call->func = func;
-            call->args = delimited(
-                "(", ")", ",", [&](auto ts)
-                { return parse_expression(ts); },
-                ts);
-            return call;
+            auto args = delimited(
+                "(", ")", ",", [&]()
+                { return parse_expression(); });
+            if (!args)
+                return std::unexpected(args.error());
+            auto call = make_list<call_node>(node_kind::call_t, *args);
+            tree.get<call_node>(call).func = func;
+            return mark(call, begin_of(func));
         }
-        auto parse_varname(ccpp::token_stream ts)
+        result<node_id> parse_varname()
         {
-            auto name = ts.next();
-            if (name->type != "var")
-                ts.croak("Expecting variable name");
-            return name;
+            if (ts.peek().kind != lexeme_kind::var)
+                return std::unexpected(fail("Expecting variable name"));
+            return make_atom(ts.next());
         }
 
         /*
          function parse_if() {
-             skip_kw("if");
+             skip_kw(keyword::if_);
              var cond = parse_expression();
              if (!is_punc("{")) skip_kw("then");
              var then = parse_expression();
@@ -216,27 +399,42 @@ namespace ccpp
                  cond: cond,
                  then: then,
              };
-             if (is_kw("else")) {
+             if (is_kw(keyword::else_)) {
                  input.next();
                  ret.else = parse_expression();
              }
              return ret;
          }
          */
-        auto parse_if(ccpp::token_stream ts)
-        {
-            skip_kw("if", ts);
-            auto ret = std::make_shared<ccpp::token>();
-            ret->cond = parse_expression(ts);
-            if (!is_punc("{", ts))
-                skip_kw("then", ts);
-            ret->then = parse_expression(ts);
-            if (is_kw("else", ts))
+        result<node_id> parse_if()
+        {
+            auto begin = ts.peek().offset;
+            if (auto kw = skip_kw(keyword::if_); !kw)
+                return std::unexpected(kw.error());
+            auto cond = parse_expression();
+            if (!cond)
+                return cond;
+            if (!is_punc("{"))
+                if (auto kw = skip_kw(keyword::then); !kw)
+                    return std::unexpected(kw.error());
+            auto then = parse_expression();
+            if (!then)
+                return then;
+            auto else_ = no_node;
+            if (is_kw(keyword::else_))
             {
                 ts.next();
-                ret->else_ = parse_expression(ts);
+                auto other = parse_expression();
+                if (!other)
+                    return other;
+                else_ = *other;
             }
-            return ret;
+            auto ret = tree.make<if_node>(node_kind::if_t);
+            auto &n = tree.get<if_node>(ret);
+            n.cond = *cond;
+            n.then = *then;
+            n.else_ = else_;
+            return mark(ret, begin);
         }
         /*
          function parse_lambda() {
@@ -247,16 +445,19 @@ namespace ccpp
              };
          }
          */
-        auto parse_lambda(ccpp::token_stream ts)
+        result<node_id> parse_lambda(std::size_t begin)
         {
-            auto ret = std::make_shared<ccpp::token>();
-            ret->type = "lambda";
-            ret->vars = delimited(
-                "(", ")", ",", [&](auto ts)
-                { return parse_expression(ts); },
-                ts);
-            ret->body = parse_expression(ts);
-            return ret;
+            auto vars = delimited(
+                "(", ")", ",", [&]()
+                { return parse_varname(); });
+            if (!vars)
+                return std::unexpected(vars.error());
+            auto body = parse_expression();
+            if (!body)
+                return body;
+            auto ret = make_list<lambda_node>(node_kind::lambda_t, *vars);
+            tree.get<lambda_node>(ret).body = *body;
+            return mark(ret, begin);
         }
         /*
          function parse_bool() {
@@ -266,13 +467,10 @@ namespace ccpp
              };
          }
          */
-        auto parse_bool(ccpp::token_stream ts)
+        node_id parse_bool()
         {
-            auto ret = std::make_shared<ccpp::token>();
-            ret->type = "bool";
             auto tok = ts.next();
-            ret->value = std::holds_alternative<std::string>(tok->value) && std::get<std::string>(tok->value) == "true";
-            return ret;
+            return mark(make_bool(tok.name == static_cast<symbol>(keyword::true_)), tok.offset);
         }
         /*
          function maybe_call(expr) {
@@ -280,10 +478,13 @@ namespace ccpp
              return is_punc("(") ? parse_call(expr) : expr;
          }
          */
-        auto maybe_call(std::function<std::shared_ptr<ccpp::token>()> expr, ccpp::token_stream ts)
+        template <typename Expr>
+        result<node_id> maybe_call(Expr expr)
         {
             auto expr_ret = expr();
-            return is_punc("(", ts) ? parse_call(expr_ret, ts) : expr_ret;
+            if (!expr_ret)
+                return expr_ret;
+            return is_punc("(") ? parse_call(*expr_ret) : expr_ret;
         }
         /*
          function parse_atom() {
@@ -295,9 +496,9 @@ namespace ccpp
                      return exp;
                  }
                  if (is_punc("{")) return parse_prog();
-                 if (is_kw("if")) return parse_if();
-                 if (is_kw("true") || is_kw("false")) return parse_bool();
-                 if (is_kw("lambda") || is_kw("λ")) {
+                 if (is_kw(keyword::if_)) return parse_if();
+                 if (is_kw(keyword::true_) || is_kw(keyword::false_)) return parse_bool();
+                 if (is_kw(keyword::lambda) || is_kw(keyword::lambda_greek)) {
                      input.next();
                      return parse_lambda();
                  }
@@ -308,34 +509,36 @@ namespace ccpp
              });
          }
          */
-        std::shared_ptr<ccpp::token> parse_atom(ccpp::token_stream ts)
+        result<node_id> parse_atom()
         {
-            return maybe_call([&]()
+            if (nesting >= max_depth)
+                return std::unexpected(too_deep());
+            nesting++;
+            level guard{nesting};
+            return maybe_call([&]() -> result<node_id>
                               {
-            if (is_punc("(", ts))
+            if (is_punc("("))
             {
                 ts.next();
-                auto exp = parse_expression(ts);
-                skip_punc(")", ts);
+                auto exp = parse_expression();
+                if (!exp)
+                    return exp;
+                if (auto closed = skip_punc(")"); !closed)
+                    return std::unexpected(closed.error());
                 return exp;
             }
-            if (is_punc("{", ts))
-                return parse_prog(ts);
-            if (is_kw("if", ts))
-                return parse_if(ts);
-            if (is_kw("true", ts) || is_kw("false", ts))
-                return parse_bool(ts);
-            if (is_kw("lambda", ts) || is_kw("λ", ts))
-            {
-                ts.next();
-                return parse_lambda(ts);
-            }
-            auto tok = ts.next();
-            if (tok->type == "var" || tok->type == "num" || tok->type == "str")
-                return tok;
-            unexpected(ts);
-            return std::make_shared<ccpp::token>(); },
-                              ts);
+            if (is_punc("{"))
+                return parse_prog();
+            if (is_kw(keyword::if_))
+                return parse_if();
+            if (is_kw(keyword::true_) || is_kw(keyword::false_))
+                return parse_bool();
+            if (is_kw(keyword::lambda) || is_kw(keyword::lambda_greek))
+                return parse_lambda(ts.next().offset);
+            auto tok = ts.peek();
+            if (tok.kind == lexeme_kind::var || tok.kind == lexeme_kind::num || tok.kind == lexeme_kind::str)
+                return make_atom(ts.next());
+            return std::unexpected(unexpected()); });
         }
 
         /*
@@ -348,18 +551,39 @@ namespace ccpp
              return { type: "prog", prog: prog };
          }
          */
-        std::shared_ptr<ccpp::token> parse_toplevel(ccpp::token_stream ts)
+        result<node_id> parse_statement()
+        {
+            auto item = parse_expression();
+            if (item && !ts.eof())
+                if (auto ended = skip_punc(";"); !ended)
+                    return std::unexpected(ended.error());
+            return item;
+        }
+        // skips the rest of a toplevel statement that failed
+        void recover()
+        {
+            synchronize();
+            if (is_punc(";") || is_punc("}"))
+                ts.next();
+        }
+        std::pmr::vector<node_id> parse_items()
         {
-            auto prog = std::make_shared<ccpp::token>();
-            prog->type = "prog";
+            std::pmr::vector<node_id> prog(memory);
             while (!ts.eof())
             {
-                prog->prog.push_back(parse_expression(ts));
-                if (!ts.eof())
-                    skip_punc(";", ts);
+                if (auto item = parse_statement())
+                    prog.push_back(*item);
+                else
+                    recover();
             }
             return prog;
         }
+        node_id parse_toplevel()
+        {
+            auto id = make_list<prog_node>(node_kind::prog_t, parse_items());
+            tree.get<node>(id).span = {0, ts.peek().offset};
+            return id;
+        }
         /*
          function parse_prog() {
              var prog = delimited("{", "}", ";", parse_expression);
@@ -368,20 +592,33 @@ namespace ccpp
              return { type: "prog", prog: prog };
          }
          */
-        std::shared_ptr<ccpp::token> parse_prog(ccpp::token_stream ts)
-        {
-            auto prog = delimited(
-                "{", "}", ";", [&](auto ts)
-                { return parse_expression(ts); },
-                ts);
-            if (prog.size() == 0)
-                return std::make_shared<ccpp::token>();
-            if (prog.size() == 1)
-                return prog[0];
-            auto ret = std::make_shared<ccpp::token>();
-            ret->type = "prog";
-            ret->prog = prog;
-            return ret;
+        result<node_id> parse_prog()
+        {
+            auto begin = ts.peek().offset;
+            auto first = tree.next_node();
+            auto text = tree.next_text();
+            std::size_t end = 0;
+            auto id = reuse ? reuse(tree, begin, end) : no_node;
+            if (id != no_node)
+                ts.skip_to(end);
+            else
+            {
+                auto prog = delimited(
+                    "{", "}", ";", [&]()
+                    { return parse_expression(); });
+                if (!prog)
+                    return std::unexpected(prog.error());
+                if (prog->size() == 0)
+                    id = mark(make_bool(false), begin);
+                else if (prog->size() == 1)
+                    id = (*prog)[0];
+                else
+                    id = mark(make_list<prog_node>(node_kind::prog_t, *prog), begin);
+                end = ts.consumed();
+            }
+            if (blocks != nullptr)
+                blocks->push_back({{static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end)}, id, first, tree.next_node(), {text, tree.next_text() - text}});
+            return id;
         }
         /*
          function parse_expression() {
@@ -390,11 +627,14 @@ namespace ccpp
              });
          }
          */
-        std::shared_ptr<ccpp::token> parse_expression(ccpp::token_stream ts)
+        result<node_id> parse_expression()
         {
             return maybe_call([&]()
-                              { return maybe_binary(parse_atom(ts), 0, ts); },
-                              ts);
+                              {
+                auto atom = parse_atom();
+                if (!atom)
+                    return atom;
+                return maybe_binary(*atom, 0); });
         }
         /*
      }
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+
+namespace ccpp
+{
+    // binds every var node to a (depth, slot) in the enclosing lambdas or to a
+    // global slot, so the runtime indexes flat frames instead of looking up names
+    class resolver
+    {
+        ccpp::ast &tree;
+        // parameter lists of the enclosing lambdas, innermost last
+        std::vector<std::span<node_id>> scopes;
+
+        void bind(node_id id)
+        {
+            auto &var = tree.get<var_node>(id);
+            for (std::size_t depth = 0; depth < scopes.size(); depth++)
+            {
+                auto params = scopes[scopes.size() - 1 - depth];
+                for (std::size_t slot = params.size(); slot-- > 0;)
+                {
+                    if (tree.get<var_node>(params[slot]).name == var.name)
+                    {
+                        var.head.op = static_cast<std::uint8_t>(var_scope::local);
+                        var.head.flags = static_cast<std::uint16_t>(depth);
+                        var.head.count = static_cast<std::uint32_t>(slot);
+                        return;
+                    }
+                }
+            }
+            var.head.op = static_cast<std::uint8_t>(var_scope::global);
+            var.head.flags = 0;
+            var.head.count = var.name;
+        }
+        void visit(node_id id)
+        {
+            if (id == no_node)
+                return;
+            switch (tree.kind(id))
+            {
+            case node_kind::num_t:
+            case node_kind::str_t:
+            case node_kind::bool_t:
+                return;
+            case node_kind::var_t:
+                bind(id);
+                return;
+            case node_kind::assign_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                if (tree.kind(n.left) != node_kind::var_t)
+                    throw exception("Cannot assign to " + std::string(to_string(tree.kind(n.left))));
+                visit(n.left);
+                visit(n.right);
+                return;
+            }
+            case node_kind::binary_t:
+            {
+                auto &n = tree.get<binary_node>(id);
+                visit(n.left);
+                visit(n.right);
+                return;
+            }
+            case node_kind::call_t:
+                visit(tree.get<call_node>(id).func);
+                for (auto arg : tree.children<call_node>(id))
+                    visit(arg);
+                return;
+            case node_kind::if_t:
+            {
+                auto &n = tree.get<if_node>(id);
+                visit(n.cond);
+                visit(n.then);
+                visit(n.else_);
+                return;
+            }
+            case node_kind::lambda_t:
+            {
+                auto params = tree.children<lambda_node>(id);
+                if (scopes.size() >= 0xffff)
+                    throw exception("Lambdas nested too deeply");
+                for (std::size_t slot = 0; slot < params.size(); slot++)
+                {
+                    auto &param = tree.get<var_node>(params[slot]);
+                    param.head.op = static_cast<std::uint8_t>(var_scope::local);
+                    param.head.flags = 0;
+                    param.head.count = static_cast<std::uint32_t>(slot);
+                }
+                scopes.push_back(params);
+                visit(tree.get<lambda_node>(id).body);
+                scopes.pop_back();
+                return;
+            }
+            case node_kind::prog_t:
+                for (auto item : tree.children<prog_node>(id))
+                    visit(item);
+                return;
+            }
+        }
+
+    public:
+        resolver(ccpp::ast &tree) : tree(tree) {}
+        void resolve()
+        {
+            scopes.clear();
+            visit(tree.root);
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ccpp.builtins.hpp"
+#include "ccpp.value.hpp"
+
+// support code for the c++ emitted by ccpp::codegen
+namespace ccpp::runtime
+{
+    struct frame
+    {
+        std::shared_ptr<frame> parent;
+        std::vector<value> slots;
+    };
+    struct closure;
+    using function = value (*)(const closure &self, std::span<const value> args);
+    struct closure : object
+    {
+        function fn;
+        std::uint32_t params;
+        std::shared_ptr<frame> env;
+
+        closure(function fn, std::uint32_t params, std::shared_ptr<frame> env) : object(object_kind::closure), fn(fn), params(params), env(std::move(env)) {}
+    };
+
+    // operands are built in one braced list so they are evaluated left to right
+    struct operands
+    {
+        value left;
+        value right;
+    };
+
+    inline value make_closure(function fn, std::uint32_t params, std::shared_ptr<frame> env)
+    {
+        return make_object<closure>(fn, params, std::move(env));
+    }
+    // the frame of one call, missing arguments are false
+    inline std::shared_ptr<frame> enter(const closure &fn, std::span<const value> args)
+    {
+        auto env = std::make_shared<frame>();
+        env->parent = fn.env;
+        env->slots.assign(args.begin(), args.end());
+        env->slots.resize(fn.params, value(false));
+        return env;
+    }
+    inline frame *up(frame *env, std::uint32_t depth)
+    {
+        for (; depth > 0; depth--)
+            env = env->parent.get();
+        return env;
+    }
+    inline const value &read(const value &global, const char *name)
+    {
+        if (global.is_nil())
+            throw exception("Undefined variable " + std::string(name));
+        return global;
+    }
+    inline bool truthy(const value &v)
+    {
+        return v.truthy();
+    }
+
+    template <op_kind op>
+    value binary(const operands &o)
+    {
+        if (value::both_int(o.left, o.right))
+        {
+            std::int64_t a = o.left.as_int(), b = o.right.as_int();
+            if constexpr (op == op_kind::add)
+                return int_result(a + b);
+            else if constexpr (op == op_kind::sub)
+                return int_result(a - b);
+            else if constexpr (op == op_kind::mul)
+                return int_result(a * b);
+            else if constexpr (op == op_kind::lt)
+                return a < b;
+            else if constexpr (op == op_kind::gt)
+                return a > b;
+            else if constexpr (op == op_kind::le)
+                return a <= b;
+            else if constexpr (op == op_kind::ge)
+                return a >= b;
+            else if constexpr (op == op_kind::eq)
+                return a == b;
+            else if constexpr (op == op_kind::ne)
+                return a != b;
+        }
+        return apply_op(op, o.left, o.right);
+    }
+
+    // non-tail calls run on the native stack, deeper nesting than this is
+    // reported instead of overflowing it
+    inline std::size_t max_depth = 1 << 14;
+    inline std::size_t depth = 0;
+    struct depth_guard
+    {
+        depth_guard()
+        {
+            if (depth >= max_depth)
+                throw exception("Stack overflow");
+            depth++;
+        }
+        ~depth_guard()
+        {
+            depth--;
+        }
+    };
+
+    // callee first, then the arguments, all in evaluation order
+    inline value call(std::span<const value> list)
+    {
+        depth_guard guard;
+        auto &callee = list[0];
+        auto args = list.subspan(1);
+        if (callee.is(object_kind::closure))
+        {
+            auto &fn = *static_cast<const closure *>(callee.as_object());
+            return fn.fn(fn, args);
+        }
+        if (callee.is(object_kind::native))
+            return static_cast<native_object *>(callee.as_object())->fn(args);
+        throw exception(callee.to_string() + " is not a function");
+    }
+    inline value call(std::initializer_list<value> list)
+    {
+        return call(std::span<const value>(list.begin(), list.size()));
+    }
+    // the closure when `callee` runs `fn`, for turning self tail calls into jumps
+    inline const closure *runs(const value &callee, function fn)
+    {
+        if (!callee.is(object_kind::closure))
+            return nullptr;
+        auto target = static_cast<const closure *>(callee.as_object());
+        return target->fn == fn ? target : nullptr;
+    }
+
+    // the host function a script refers to by `name`, nil if there is none
+    inline value builtin(std::string_view name)
+    {
+        static const auto table = []
+        {
+            std::unordered_map<std::string, value> table;
+            define_builtins([&](std::string_view name, value v)
+                            { table.emplace(name, std::move(v)); },
+                            std::cout);
+            return table;
+        }();
+        auto it = table.find(std::string(name));
+        return it != table.end() ? it->second : value();
+    }
+} // namespace ccpp::runtime
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ccpp.char_class.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CCPP_SCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define CCPP_SCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace ccpp
+{
+    // run scanning kernels for the lexer, every kernel takes [p, end) and returns
+    // the first position that does not belong to the run (end if the run reaches it).
+    // line_starts instead appends `at` plus the index after every '\n' in it
+    namespace scan
+    {
+        namespace scalar
+        {
+            inline const char *whitespace(const char *p, const char *end)
+            {
+                while (p < end && char_class::is(*p, char_class::whitespace))
+                    p++;
+                return p;
+            }
+            inline const char *ident(const char *p, const char *end)
+            {
+                while (p < end && char_class::is(*p, char_class::id))
+                    p++;
+                return p;
+            }
+            inline const char *find(const char *p, const char *end, char ch)
+            {
+                while (p < end && *p != ch)
+                    p++;
+                return p;
+            }
+            inline const char *find_either(const char *p, const char *end, char a, char b)
+            {
+                while (p < end && *p != a && *p != b)
+                    p++;
+                return p;
+            }
+            inline void line_starts(const char *p, const char *end, std::size_t at, std::vector<std::size_t> &out)
+            {
+                for (auto q = p; q < end; q++)
+                    if (*q == '\n')
+                        out.push_back(at + static_cast<std::size_t>(q - p) + 1);
+            }
+        } // namespace scalar
+
+        inline int first_set(unsigned mask)
+        {
+#if defined(__GNUC__)
+            return __builtin_ctz(mask);
+#else
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<int>(index);
+#endif
+        }
+
+#ifdef CCPP_SCAN_SSE2
+        namespace sse2
+        {
+            inline __m128i whitespace_mask(__m128i x)
+            {
+                __m128i sp = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+                __m128i tab = _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'));
+                __m128i nl = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+                return _mm_or_si128(sp, _mm_or_si128(tab, nl));
+            }
+            // (x - lo) <= span as unsigned bytes
+            inline __m128i in_range(__m128i x, char lo, char span)
+            {
+                __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+                return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+            }
+            inline __m128i ident_mask(__m128i x)
+            {
+                __m128i alpha = in_range(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+                __m128i digit = in_range(x, '0', 9);
+                __m128i high = _mm_cmplt_epi8(x, _mm_setzero_si128());
+                __m128i m = _mm_or_si128(alpha, _mm_or_si128(digit, high));
+                for (char ch : {'_', '?', '!', '-', '<', '>', '='})
+                    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(ch)));
+                return m;
+            }
+            inline const char *whitespace(const char *p, const char *end)
+            {
+                for (; end - p >= 16; p += 16)
+                {
+                    unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(whitespace_mask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))))) & 0xffff;
+                    if (stop != 0)
+                        return p + first_set(stop);
+                }
+                return scalar::whitespace(p, end);
+            }
+            inline const char *ident(const char *p, const char *end)
+            {
+                for (; end - p >= 16; p += 16)
+                {
+                    unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(ident_mask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))))) & 0xffff;
+                    if (stop != 0)
+                        return p + first_set(stop);
+                }
+                return scalar::ident(p, end);
+            }
+            inline const char *find(const char *p, const char *end, char ch)
+            {
+                __m128i c = _mm_set1_epi8(ch);
+                for (; end - p >= 16; p += 16)
+                {
+                    unsigned hit = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), c)));
+                    if (hit != 0)
+                        return p + first_set(hit);
+                }
+                return scalar::find(p, end, ch);
+            }
+            inline const char *find_either(const char *p, const char *end, char a, char b)
+            {
+                __m128i ca = _mm_set1_epi8(a);
+                __m128i cb = _mm_set1_epi8(b);
+                for (; end - p >= 16; p += 16)
+                {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                    unsigned hit = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, ca), _mm_cmpeq_epi8(x, cb))));
+                    if (hit != 0)
+                        return p + first_set(hit);
+                }
+                return scalar::find_either(p, end, a, b);
+            }
+            inline void line_starts(const char *p, const char *end, std::size_t at, std::vector<std::size_t> &out)
+            {
+                __m128i nl = _mm_set1_epi8('\n');
+                auto q = p;
+                for (; end - q >= 16; q += 16)
+                {
+                    unsigned hit = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(q)), nl)));
+                    for (; hit != 0; hit &= hit - 1)
+                        out.push_back(at + static_cast<std::size_t>(q - p) + first_set(hit) + 1);
+                }
+                scalar::line_starts(q, end, at + static_cast<std::size_t>(q - p), out);
+            }
+        } // namespace sse2
+#endif
+
+#ifdef CCPP_SCAN_AVX2
+        namespace avx2
+        {
+#define CCPP_AVX2_TARGET __attribute__((target("avx2")))
+            CCPP_AVX2_TARGET inline __m256i in_range(__m256i x, char lo, char span)
+            {
+                __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+                return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+            }
+            CCPP_AVX2_TARGET inline const char *whitespace(const char *p, const char *end)
+            {
+                for (; end - p >= 32; p += 32)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                    __m256i sp = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '));
+                    __m256i tab = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t'));
+                    __m256i nl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+                    unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(sp, _mm256_or_si256(tab, nl))));
+                    if (stop != 0)
+                        return p + first_set(stop);
+                }
+                return sse2::whitespace(p, end);
+            }
+            CCPP_AVX2_TARGET inline const char *ident(const char *p, const char *end)
+            {
+                for (; end - p >= 32; p += 32)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                    __m256i alpha = in_range(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+                    __m256i digit = in_range(x, '0', 9);
+                    __m256i high = _mm256_cmpgt_epi8(_mm256_setzero_si256(), x);
+                    __m256i m = _mm256_or_si256(alpha, _mm256_or_si256(digit, high));
+                    for (char ch : {'_', '?', '!', '-', '<', '>', '='})
+                        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(ch)));
+                    unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(m));
+                    if (stop != 0)
+                        return p + first_set(stop);
+                }
+                return sse2::ident(p, end);
+            }
+            CCPP_AVX2_TARGET inline const char *find(const char *p, const char *end, char ch)
+            {
+                __m256i c = _mm256_set1_epi8(ch);
+                for (; end - p >= 32; p += 32)
+                {
+                    unsigned hit = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), c)));
+                    if (hit != 0)
+                        return p + first_set(hit);
+                }
+                return sse2::find(p, end, ch);
+            }
+            CCPP_AVX2_TARGET inline const char *find_either(const char *p, const char *end, char a, char b)
+            {
+                __m256i ca = _mm256_set1_epi8(a);
+                __m256i cb = _mm256_set1_epi8(b);
+                for (; end - p >= 32; p += 32)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                    unsigned hit = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, ca), _mm256_cmpeq_epi8(x, cb))));
+                    if (hit != 0)
+                        return p + first_set(hit);
+                }
+                return sse2::find_either(p, end, a, b);
+            }
+            CCPP_AVX2_TARGET inline void line_starts(const char *p, const char *end, std::size_t at, std::vector<std::size_t> &out)
+            {
+                __m256i nl = _mm256_set1_epi8('\n');
+                auto q = p;
+                for (; end - q >= 32; q += 32)
+                {
+                    unsigned hit = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(q)), nl)));
+                    for (; hit != 0; hit &= hit - 1)
+                        out.push_back(at + static_cast<std::size_t>(q - p) + first_set(hit) + 1);
+                }
+                sse2::line_starts(q, end, at + static_cast<std::size_t>(q - p), out);
+            }
+#undef CCPP_AVX2_TARGET
+        } // namespace avx2
+#endif
+
+        struct kernels
+        {
+            const char *name;
+            const char *(*whitespace)(const char *, const char *);
+            const char *(*ident)(const char *, const char *);
+            const char *(*find)(const char *, const char *, char);
+            const char *(*find_either)(const char *, const char *, char, char);
+            void (*line_starts)(const char *, const char *, std::size_t, std::vector<std::size_t> &);
+        };
+
+        inline kernels select()
+        {
+#ifdef CCPP_SCAN_AVX2
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return {"avx2", avx2::whitespace, avx2::ident, avx2::find, avx2::find_either, avx2::line_starts};
+#endif
+#ifdef CCPP_SCAN_SSE2
+            return {"sse2", sse2::whitespace, sse2::ident, sse2::find, sse2::find_either, sse2::line_starts};
+#else
+            return {"scalar", scalar::whitespace, scalar::ident, scalar::find, scalar::find_either, scalar::line_starts};
+#endif
+        }
+
+        // picked once at startup from what the cpu supports
+        inline const kernels active = select();
+
+        inline const char *whitespace(const char *p, const char *end) { return active.whitespace(p, end); }
+        inline const char *ident(const char *p, const char *end) { return active.ident(p, end); }
+        inline const char *find(const char *p, const char *end, char ch) { return active.find(p, end, ch); }
+        inline const char *find_either(const char *p, const char *end, char a, char b) { return active.find_either(p, end, a, b); }
+        inline void line_starts(const char *p, const char *end, std::size_t at, std::vector<std::size_t> &out) { active.line_starts(p, end, at, out); }
+    } // namespace scan
+} // namespace ccpp
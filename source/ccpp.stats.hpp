@@ -0,0 +1,297 @@
+#pragma once
+
+// counters and timers for finding where the time goes between the phases of
+// a run. they only exist when CCPP_STATS is defined (cmake -DCCPP_STATS=ON),
+// otherwise the macros below expand to nothing and none of this is compiled.
+//
+//   CCPP_STATS_PHASE(parse);          the rest of the scope is the parse phase
+//   CCPP_STATS_COUNT(tokens, 1);      counts into the phase running now
+//   CCPP_STATS_ALLOCATION_HOOK()      once, at file scope, in the driver:
+//                                     replaces operator new to count allocations
+//
+// counts go to the phase the program is in, whichever thread makes them, so
+// the pool's work while parsing in parallel is the parse phase's. times are
+// inclusive of phases entered inside
+
+#ifdef CCPP_STATS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string_view>
+
+namespace ccpp
+{
+    namespace stats
+    {
+        enum class phase : std::uint8_t
+        {
+            other,
+            read,
+            lex,
+            parse,
+            optimize,
+            compile,
+            run,
+        };
+        inline constexpr std::size_t phases = 7;
+        inline std::string_view to_string(phase p)
+        {
+            constexpr std::string_view names[phases] = {"other", "read", "lex", "parse", "optimize", "compile", "run"};
+            return names[static_cast<std::size_t>(p)];
+        }
+
+        enum class counter : std::uint8_t
+        {
+            tokens,
+            nodes,
+            allocations,
+            bytes,
+        };
+        inline constexpr std::size_t counters = 4;
+
+        struct phase_report
+        {
+            std::array<std::uint64_t, counters> counts{};
+            std::uint64_t entered = 0;
+            double wall_ms = 0;
+            // of the whole process, so it includes the pool's threads
+            double cpu_ms = 0;
+
+            std::uint64_t operator[](counter c) const
+            {
+                return counts[static_cast<std::size_t>(c)];
+            }
+        };
+        struct report
+        {
+            std::array<phase_report, phases> by_phase{};
+
+            const phase_report &operator[](phase p) const
+            {
+                return by_phase[static_cast<std::size_t>(p)];
+            }
+            // a table with a row for each phase that saw anything
+            void print(std::ostream &os) const
+            {
+                char line[160];
+                std::snprintf(line, sizeof(line), "%-9s %7s %11s %11s %11s %11s %11s %13s\n", "phase", "entered", "wall ms", "cpu ms", "tokens",
+                              "nodes", "allocs", "bytes");
+                os << line;
+                for (std::size_t i = 0; i < phases; i++)
+                {
+                    auto &r = by_phase[i];
+                    if (r.entered == 0 && r.counts == decltype(r.counts){})
+                        continue;
+                    std::snprintf(line, sizeof(line), "%-9s %7llu %11.3f %11.3f %11llu %11llu %11llu %13llu\n", to_string(static_cast<phase>(i)).data(),
+                                  static_cast<unsigned long long>(r.entered), r.wall_ms, r.cpu_ms,
+                                  static_cast<unsigned long long>(r[counter::tokens]), static_cast<unsigned long long>(r[counter::nodes]),
+                                  static_cast<unsigned long long>(r[counter::allocations]), static_cast<unsigned long long>(r[counter::bytes]));
+                    os << line;
+                }
+            }
+        };
+
+        namespace detail
+        {
+            // the counts of one thread. only the thread adds to them, so
+            // they are plain increments, others just read them. linked into
+            // a list without allocating, operator new counts into it
+            struct local
+            {
+                std::atomic<std::uint64_t> values[phases][counters] = {};
+                local *next = nullptr;
+                bool linked = false;
+                bool ended = false;
+
+                ~local();
+            };
+            struct registry
+            {
+                std::mutex lock;
+                local *threads = nullptr;
+                // what threads that ended had counted
+                std::uint64_t retired[phases][counters] = {};
+                double wall_ms[phases] = {};
+                double cpu_ms[phases] = {};
+                std::uint64_t entered[phases] = {};
+            };
+            // constant-initialized, so it is there for allocations made
+            // before main
+            inline registry global;
+            inline std::atomic<phase> current{phase::other};
+            inline thread_local local mine;
+
+            inline local::~local()
+            {
+                std::lock_guard guard(global.lock);
+                if (linked)
+                {
+                    for (auto p = &global.threads; *p != nullptr; p = &(*p)->next)
+                        if (*p == this)
+                        {
+                            *p = next;
+                            break;
+                        }
+                    for (std::size_t i = 0; i < phases; i++)
+                        for (std::size_t c = 0; c < counters; c++)
+                            global.retired[i][c] += values[i][c].load(std::memory_order_relaxed);
+                }
+                linked = false;
+                ended = true;
+            }
+        } // namespace detail
+
+        inline void add(counter c, std::uint64_t n)
+        {
+            auto &mine = detail::mine;
+            if (!mine.linked) [[unlikely]]
+            {
+                if (mine.ended)
+                    return;
+                std::lock_guard guard(detail::global.lock);
+                mine.next = detail::global.threads;
+                detail::global.threads = &mine;
+                mine.linked = true;
+            }
+            auto &value = mine.values[static_cast<std::size_t>(detail::current.load(std::memory_order_relaxed))][static_cast<std::size_t>(c)];
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        // the program is in phase `p` until the scope ends, then back in the
+        // phase it was in before
+        class scope
+        {
+            phase entered;
+            phase previous;
+            std::chrono::steady_clock::time_point wall;
+            std::clock_t cpu;
+
+        public:
+            explicit scope(phase p)
+                : entered(p), previous(detail::current.exchange(p, std::memory_order_relaxed)), wall(std::chrono::steady_clock::now()), cpu(std::clock()) {}
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+            ~scope()
+            {
+                auto cpu_ms = 1000.0 * static_cast<double>(std::clock() - cpu) / CLOCKS_PER_SEC;
+                auto wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall).count();
+                {
+                    std::lock_guard guard(detail::global.lock);
+                    auto i = static_cast<std::size_t>(entered);
+                    detail::global.wall_ms[i] += wall_ms;
+                    detail::global.cpu_ms[i] += cpu_ms;
+                    detail::global.entered[i]++;
+                }
+                detail::current.store(previous, std::memory_order_relaxed);
+            }
+        };
+
+        // everything counted so far, by the threads still running and the
+        // ones that have ended
+        inline report snapshot()
+        {
+            report r;
+            std::lock_guard guard(detail::global.lock);
+            for (std::size_t i = 0; i < phases; i++)
+            {
+                auto &out = r.by_phase[i];
+                for (std::size_t c = 0; c < counters; c++)
+                    out.counts[c] = detail::global.retired[i][c];
+                for (auto t = detail::global.threads; t != nullptr; t = t->next)
+                    for (std::size_t c = 0; c < counters; c++)
+                        out.counts[c] += t->values[i][c].load(std::memory_order_relaxed);
+                out.entered = detail::global.entered[i];
+                out.wall_ms = detail::global.wall_ms[i];
+                out.cpu_ms = detail::global.cpu_ms[i];
+            }
+            return r;
+        }
+        // starts counting from zero. counts made meanwhile by other threads
+        // may survive it
+        inline void reset()
+        {
+            std::lock_guard guard(detail::global.lock);
+            for (std::size_t i = 0; i < phases; i++)
+            {
+                for (std::size_t c = 0; c < counters; c++)
+                {
+                    detail::global.retired[i][c] = 0;
+                    for (auto t = detail::global.threads; t != nullptr; t = t->next)
+                        t->values[i][c].store(0, std::memory_order_relaxed);
+                }
+                detail::global.wall_ms[i] = 0;
+                detail::global.cpu_ms[i] = 0;
+                detail::global.entered[i] = 0;
+            }
+        }
+
+        // for CCPP_STATS_ALLOCATION_HOOK
+        inline void *allocate(std::size_t size)
+        {
+            add(counter::allocations, 1);
+            add(counter::bytes, size);
+            if (auto p = std::malloc(size == 0 ? 1 : size))
+                return p;
+            throw std::bad_alloc();
+        }
+        // aligned_alloc wants a size that is a multiple of the alignment
+        inline void *allocate(std::size_t size, std::align_val_t align)
+        {
+            add(counter::allocations, 1);
+            add(counter::bytes, size);
+            auto alignment = static_cast<std::size_t>(align);
+            auto rounded = ((size == 0 ? 1 : size) + alignment - 1) / alignment * alignment;
+            if (auto p = std::aligned_alloc(alignment, rounded))
+                return p;
+            throw std::bad_alloc();
+        }
+    } // namespace stats
+} // namespace ccpp
+
+#define CCPP_STATS_PHASE(name) ::ccpp::stats::scope ccpp_stats_phase(::ccpp::stats::phase::name)
+#define CCPP_STATS_COUNT(what, n) ::ccpp::stats::add(::ccpp::stats::counter::what, n)
+// libstdc++ sends the array, nothrow and sized forms to these: the plain ones
+// to the first three, the std::align_val_t ones to the last three. the default
+// pmr resource, which trees and symbol tables allocate from, is aligned
+#define CCPP_STATS_ALLOCATION_HOOK()                                        \
+    void *operator new(std::size_t size)                                    \
+    {                                                                       \
+        return ::ccpp::stats::allocate(size);                               \
+    }                                                                       \
+    void operator delete(void *p) noexcept                                  \
+    {                                                                       \
+        std::free(p);                                                       \
+    }                                                                       \
+    void operator delete(void *p, std::size_t) noexcept                     \
+    {                                                                       \
+        std::free(p);                                                       \
+    }                                                                       \
+    void *operator new(std::size_t size, std::align_val_t align)            \
+    {                                                                       \
+        return ::ccpp::stats::allocate(size, align);                        \
+    }                                                                       \
+    void operator delete(void *p, std::align_val_t) noexcept                \
+    {                                                                       \
+        std::free(p);                                                       \
+    }                                                                       \
+    void operator delete(void *p, std::size_t, std::align_val_t) noexcept   \
+    {                                                                       \
+        std::free(p);                                                       \
+    }
+
+#else
+
+#define CCPP_STATS_PHASE(name) static_cast<void>(0)
+#define CCPP_STATS_COUNT(what, n) static_cast<void>(0)
+#define CCPP_STATS_ALLOCATION_HOOK()
+
+#endif
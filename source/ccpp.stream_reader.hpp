@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "ccpp.execption.hpp"
+
+namespace ccpp
+{
+    // a source that arrives over time (stdin, a pipe, a socket) read into a
+    // window of bounded size. the window only grows past its capacity when a
+    // single token is longer than that
+    class stream_reader
+    {
+        std::vector<char> buffer;
+        // offset in the source of buffer[0]
+        std::size_t base = 0;
+        std::size_t size = 0;
+        std::istream *in = nullptr;
+        int fd = -1;
+        bool ended = false;
+
+        // whatever is available now, blocking only while nothing is. 0 at the end
+        std::size_t read_some(char *to, std::size_t count)
+        {
+            if (in != nullptr)
+            {
+                // peek blocks for the first byte, readsome takes what is buffered
+                // behind it. streams that buffer nothing get one byte at a time
+                if (in->peek() == std::istream::traits_type::eof())
+                    return 0;
+                auto got = static_cast<std::size_t>(in->readsome(to, static_cast<std::streamsize>(count)));
+                if (got == 0)
+                    got = in->get(*to) ? 1 : 0;
+                return got;
+            }
+            for (;;)
+            {
+#ifdef _WIN32
+                auto got = ::_read(fd, to, static_cast<unsigned>(std::min<std::size_t>(count, 1u << 30)));
+#else
+                auto got = ::read(fd, to, count);
+#endif
+                if (got >= 0)
+                    return static_cast<std::size_t>(got);
+                if (errno != EINTR)
+                    throw exception("Can't read input: " + std::string(std::strerror(errno)));
+            }
+        }
+
+    public:
+        static constexpr std::size_t default_capacity = 1 << 16;
+
+        // reads `in`, which must outlive the reader
+        explicit stream_reader(std::istream &in, std::size_t capacity = default_capacity)
+            : buffer(std::max<std::size_t>(capacity, 1)), in(&in) {}
+        // reads the file descriptor `fd`, which the caller keeps open and closes
+        explicit stream_reader(int fd, std::size_t capacity = default_capacity)
+            : buffer(std::max<std::size_t>(capacity, 1)), fd(fd) {}
+
+        // drops the bytes before offset `keep` and reads at least one more,
+        // false (with nothing read) once the source has ended
+        bool fill(std::size_t keep)
+        {
+            if (ended)
+                return false;
+            auto drop = std::clamp(keep, base, base + size) - base;
+            if (drop > 0)
+            {
+                std::memmove(buffer.data(), buffer.data() + drop, size - drop);
+                size -= drop;
+                base += drop;
+            }
+            if (size == buffer.size())
+                buffer.resize(buffer.size() * 2);
+            auto got = read_some(buffer.data() + size, buffer.size() - size);
+            if (got == 0)
+            {
+                ended = true;
+                return false;
+            }
+            size += got;
+            return true;
+        }
+        // the bytes held, starting at offset start() in the source. moves on fill()
+        std::string_view window() const
+        {
+            return std::string_view(buffer.data(), size);
+        }
+        std::size_t start() const
+        {
+            return base;
+        }
+        std::size_t capacity() const
+        {
+            return buffer.size();
+        }
+    };
+} // namespace ccpp
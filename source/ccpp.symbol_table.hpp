@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ccpp
+{
+    // dense id of an interned name, keywords take the first ids
+    using symbol = std::uint32_t;
+
+    enum class keyword : symbol
+    {
+        if_,
+        then,
+        else_,
+        lambda,
+        lambda_greek, // λ
+        true_,
+        false_,
+    };
+
+    inline constexpr std::array<std::string_view, 7> keyword_names = {"if", "then", "else", "lambda", "λ", "true", "false"};
+
+    namespace detail
+    {
+        inline constexpr std::size_t no_keyword = keyword_names.size();
+
+        constexpr std::size_t keyword_hash(std::string_view text)
+        {
+            return (text.size() + static_cast<unsigned char>(text.front()) + static_cast<unsigned char>(text.back())) & 15;
+        }
+        constexpr std::array<std::uint8_t, 16> make_keyword_slots()
+        {
+            std::array<std::uint8_t, 16> slots{};
+            slots.fill(no_keyword);
+            for (std::size_t i = 0; i < keyword_names.size(); i++)
+            {
+                if (slots[keyword_hash(keyword_names[i])] != no_keyword)
+                    throw "keyword hash collision";
+                slots[keyword_hash(keyword_names[i])] = static_cast<std::uint8_t>(i);
+            }
+            return slots;
+        }
+        // perfect hash over the keyword set, a collision fails to compile
+        inline constexpr std::array<std::uint8_t, 16> keyword_slots = make_keyword_slots();
+    } // namespace detail
+
+    // keyword id for `text`, or false if it is an ordinary name
+    constexpr bool lookup_keyword(std::string_view text, symbol &id)
+    {
+        if (text.empty())
+            return false;
+        auto slot = detail::keyword_slots[detail::keyword_hash(text)];
+        if (slot == detail::no_keyword || keyword_names[slot] != text)
+            return false;
+        id = slot;
+        return true;
+    }
+
+    // per-compilation interner, keywords are pre-seeded with their keyword ids.
+    // names and the index over them come from `resource`
+    class symbol_table
+    {
+        std::pmr::deque<std::pmr::string> storage;
+        std::pmr::vector<std::string_view> names;
+        std::pmr::unordered_map<std::string_view, symbol> ids;
+
+    public:
+        explicit symbol_table(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+            : storage(resource), names(resource), ids(resource)
+        {
+            for (auto kw : keyword_names)
+                intern(kw);
+        }
+        symbol_table(const symbol_table &) = delete;
+        symbol_table &operator=(const symbol_table &) = delete;
+
+        static constexpr bool is_keyword(symbol id)
+        {
+            return id < keyword_names.size();
+        }
+
+        symbol intern(std::string_view name)
+        {
+            if (auto it = ids.find(name); it != ids.end())
+                return it->second;
+            auto id = static_cast<symbol>(names.size());
+            std::string_view stored = storage.emplace_back(name);
+            names.push_back(stored);
+            ids.emplace(stored, id);
+            return id;
+        }
+        std::string_view name(symbol id) const
+        {
+            return names[id];
+        }
+        std::size_t size() const
+        {
+            return names.size();
+        }
+    };
+} // namespace ccpp
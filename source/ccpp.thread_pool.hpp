@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ccpp
+{
+    // fixed set of worker threads for the parallel front end
+    class thread_pool
+    {
+        std::vector<std::jthread> workers;
+        std::mutex lock;
+        std::condition_variable ready;
+        std::deque<std::function<void()>> tasks;
+        bool stopping = false;
+
+        void work()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock guard(lock);
+                    ready.wait(guard, [&]
+                               { return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                        return;
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+        void submit(std::function<void()> task)
+        {
+            {
+                std::lock_guard guard(lock);
+                tasks.push_back(std::move(task));
+            }
+            ready.notify_one();
+        }
+
+    public:
+        explicit thread_pool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+        {
+            workers.reserve(threads);
+            for (std::size_t i = 0; i < threads; i++)
+                workers.emplace_back([this]
+                                     { work(); });
+        }
+        thread_pool(const thread_pool &) = delete;
+        thread_pool &operator=(const thread_pool &) = delete;
+        ~thread_pool()
+        {
+            {
+                std::lock_guard guard(lock);
+                stopping = true;
+            }
+            ready.notify_all();
+            // joined here, while the queue and its lock still exist. calls
+            // run() gave up on may still be queued
+            workers.clear();
+        }
+
+        std::size_t size() const
+        {
+            return workers.size();
+        }
+
+        // calls fn(i) for every i < count and returns when all are done. the
+        // caller takes indices too, and once none are left it only waits for
+        // the helpers already running: those still queued are called off and
+        // do nothing when a worker gets to them. so a task can call run() on
+        // the pool it runs on, even with every worker busy, and the caller
+        // does the work alone. every participant starts on its own slice of
+        // the indices and, once that runs out, steals the back half of
+        // whichever slice is left, so uneven work spreads without a shared
+        // counter. the first exception thrown by fn is rethrown here
+        template <typename Fn>
+        void run(std::size_t count, Fn fn)
+        {
+            struct slice
+            {
+                std::mutex lock;
+                std::size_t begin = 0;
+                std::size_t end = 0;
+            };
+            auto helpers = std::min(size(), count > 0 ? count - 1 : 0);
+            auto parts = helpers + 1;
+            auto slices = std::make_unique<slice[]>(parts);
+            for (std::size_t i = 0; i < parts; i++)
+            {
+                slices[i].begin = count * i / parts;
+                slices[i].end = count * (i + 1) / parts;
+            }
+            auto take = [&](std::size_t self, std::size_t &index)
+            {
+                auto &own = slices[self];
+                {
+                    std::lock_guard guard(own.lock);
+                    if (own.begin < own.end)
+                    {
+                        index = own.begin++;
+                        return true;
+                    }
+                }
+                for (std::size_t k = 1; k < parts; k++)
+                {
+                    auto &victim = slices[(self + k) % parts];
+                    std::size_t begin, end;
+                    {
+                        std::lock_guard guard(victim.lock);
+                        if (victim.begin >= victim.end)
+                            continue;
+                        end = victim.end;
+                        begin = victim.end -= (victim.end - victim.begin + 1) / 2;
+                    }
+                    std::lock_guard guard(own.lock);
+                    own.begin = begin + 1;
+                    own.end = end;
+                    index = begin;
+                    return true;
+                }
+                return false;
+            };
+
+            std::exception_ptr error;
+            std::mutex error_lock;
+            auto drain = [&](std::size_t self)
+            {
+                for (std::size_t i; take(self, i);)
+                {
+                    try
+                    {
+                        fn(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard guard(error_lock);
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                }
+            };
+            // outlives run() in the helpers still queued when it returns,
+            // which must not touch anything else then
+            struct control
+            {
+                std::mutex lock;
+                std::condition_variable idle;
+                std::size_t running = 0;
+                bool closed = false;
+            };
+            auto state = std::make_shared<control>();
+            for (std::size_t i = 0; i < helpers; i++)
+                submit([&drain, state, i]
+                       {
+                           {
+                               std::lock_guard guard(state->lock);
+                               if (state->closed)
+                                   return;
+                               state->running++;
+                           }
+                           drain(i + 1);
+                           std::lock_guard guard(state->lock);
+                           if (--state->running == 0)
+                               state->idle.notify_all(); });
+            drain(0);
+            {
+                // every index has been taken, by the caller or by a helper
+                // that is running and will finish it
+                std::unique_lock guard(state->lock);
+                state->closed = true;
+                state->idle.wait(guard, [&]
+                                 { return state->running == 0; });
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        // shared by everything that doesn't bring its own pool
+        static thread_pool &shared()
+        {
+            static thread_pool pool;
+            return pool;
+        }
+    };
+} // namespace ccpp
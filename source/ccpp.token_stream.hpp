@@ -1,78 +1,187 @@
 #pragma once
 
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "ccpp.char_class.hpp"
+#include "ccpp.diagnostics.hpp"
 #include "ccpp.input_stream.hpp"
-#include "ccpp.token.hpp"
+#include "ccpp.lexeme.hpp"
+#include "ccpp.scan.hpp"
+#include "ccpp.stats.hpp"
 
 namespace ccpp
 {
     class token_stream
     {
-        std::shared_ptr<token> current = nullptr;
-        std::string keywords = " if then else lambda λ true false ";
+        lexeme current;
+        bool peeked = false;
+        // end of the last token taken by next()
+        std::size_t taken = 0;
         ccpp::input_stream input;
+        std::shared_ptr<ccpp::symbol_table> table;
+        std::pmr::memory_resource *memory = std::pmr::get_default_resource();
+        // pre-lexed tokens to hand out instead of lexing, then eof at replay_end
+        std::span<const lexeme> replay;
+        std::size_t replayed = 0;
+        std::size_t replay_end = 0;
+        bool replaying = false;
+
+        lexeme replay_next()
+        {
+            lexeme tok;
+            if (replayed < replay.size())
+                tok = replay[replayed++];
+            else
+            {
+                tok.kind = lexeme_kind::eof;
+                tok.offset = static_cast<std::uint32_t>(replay_end);
+                tok.length = 0;
+            }
+            return tok;
+        }
 
     public:
-        token_stream(ccpp::input_stream input) : input(input) {}
-        std::shared_ptr<token> next()
+        // when set, lex errors are reported here and lexing goes on after the
+        // bad text, else the first one is thrown
+        ccpp::diagnostics *diagnostics = nullptr;
+
+        token_stream(ccpp::input_stream input, std::shared_ptr<ccpp::symbol_table> symbols = std::make_shared<ccpp::symbol_table>())
+            : input(std::move(input)), table(std::move(symbols)) {}
+        // interns into a table of its own made from `resource`, which a parser
+        // of this stream then takes its trees and scratch space from too
+        token_stream(ccpp::input_stream input, std::pmr::memory_resource *resource)
+            : input(std::move(input)), table(std::allocate_shared<ccpp::symbol_table>(std::pmr::polymorphic_allocator<ccpp::symbol_table>(resource), resource)),
+              memory(resource) {}
+        // replays `tokens` lexed from `input` with names in `symbols`, followed
+        // by an eof token at offset `end`
+        token_stream(ccpp::input_stream input, std::span<const lexeme> tokens, std::size_t end, std::shared_ptr<ccpp::symbol_table> symbols)
+            : input(std::move(input)), table(std::move(symbols)), replay(tokens), replay_end(end), replaying(true) {}
+        lexeme next()
         {
-            auto tok = current;
-            current = nullptr;
-            return tok == nullptr ? read_next() : tok;
+            lexeme tok;
+            if (peeked)
+            {
+                peeked = false;
+                tok = current;
+            }
+            else
+                tok = read_next();
+            taken = tok.offset + tok.length;
+            return tok;
         }
-        std::shared_ptr<token> peek()
+        lexeme peek()
         {
-            if (current == nullptr)
+            if (!peeked)
+            {
                 current = read_next();
+                peeked = true;
+            }
             return current;
         }
         bool eof()
         {
-            return peek() == nullptr;
+            return peek().kind == lexeme_kind::eof;
         }
-        void croak(std::string msg)
+        // where the last token taken by next() ends
+        std::size_t consumed() const
         {
-            input.croak(msg);
+            return taken;
         }
-        bool is_keyword(std::string x)
+        // drops replayed tokens up to `offset`, for a parser reusing the
+        // subtree of a stretch it has seen before
+        void skip_to(std::size_t offset)
         {
-            return keywords.find(" " + x + " ") != std::string::npos;
+            if (peeked && current.offset >= offset)
+                return;
+            peeked = false;
+            while (replayed < replay.size() && replay[replayed].offset < offset)
+                replayed++;
+            taken = offset;
+        }
+        // reports a problem with `span` to the diagnostics, or throws it
+        // when there are none
+        CCPP_COLD failure fail(std::string msg, source_span span)
+        {
+            auto problem = input.diagnose(std::move(msg), span);
+            if (diagnostics == nullptr)
+                throw exception(problem.text());
+            return diagnostics->report(std::move(problem));
+        }
+        // over a stream_reader only the text of the last token lexed is kept
+        std::string_view text(const lexeme &tok) const
+        {
+            return input.slice(tok.offset, tok.length);
+        }
+        // identifiers and keywords of this stream are interned here
+        const std::shared_ptr<ccpp::symbol_table> &symbols() const
+        {
+            return table;
+        }
+        std::pmr::memory_resource *resource() const
+        {
+            return memory;
         }
         bool is_digit(char ch)
         {
-            return std::isdigit(ch);
+            return char_class::is(ch, char_class::digit);
         }
         bool is_id_start(char ch)
         {
-            return std::isalpha(ch) || ch == '_' || ch == 'λ';
+            return char_class::is(ch, char_class::id_start);
         }
         bool is_id(char ch)
         {
-            return is_id_start(ch) || std::string("?!-<>=0123456789").find(ch) != std::string::npos;
+            return char_class::is(ch, char_class::id);
         }
         bool is_op_char(char ch)
         {
-            return std::string("+-*/%=&|<>!").find(ch) != std::string::npos;
+            return char_class::is(ch, char_class::op);
         }
         bool is_punc(char ch)
         {
-            return std::string(",;(){}[]").find(ch) != std::string::npos;
+            return char_class::is(ch, char_class::punc);
         }
         bool is_whitespace(char ch)
         {
-            return std::string(" \t\n").find(ch) != std::string::npos;
+            return char_class::is(ch, char_class::whitespace);
+        }
+        template <typename Predicate>
+        std::string_view read_while(Predicate predicate)
+        {
+            return input.take_run([&](const char *p, const char *end)
+                                  {
+                while (p < end && predicate(*p))
+                    p++;
+                return p; });
+        }
+        source_span span_of(std::string_view slice) const
+        {
+            auto begin = static_cast<std::uint32_t>(input.offset_of(slice.data()));
+            return {begin, static_cast<std::uint32_t>(begin + slice.size())};
         }
-        std::string read_while(std::function<bool(char)> predicate)
+        CCPP_INLINE result<lexeme> make(lexeme_kind kind, std::string_view slice)
         {
-            std::string str = "";
-            while (!input.eof() && predicate(input.peek()))
-                str += input.next();
-            return str;
+            if (slice.size() > lexeme::max_length)
+                return std::unexpected(fail("Token too long", span_of(slice)));
+            lexeme tok;
+            tok.kind = kind;
+            tok.offset = static_cast<std::uint32_t>(input.offset_of(slice.data()));
+            tok.length = static_cast<std::uint32_t>(slice.size());
+            return tok;
         }
-        std::shared_ptr<token> read_number()
+        CCPP_INLINE result<lexeme> read_number()
         {
             bool has_dot = false;
-            std::string number = read_while([&](char ch)
-                                            {
+            auto number = read_while([&](char ch)
+                                     {
                 if (ch == '.')
                 {
                     if (has_dot)
@@ -81,77 +190,108 @@ namespace ccpp
                     return true;
                 }
                 return is_digit(ch); });
-            return token::create("num", std::stod(number));
+            auto tok = make(lexeme_kind::num, number);
+            if (tok && std::from_chars(number.data(), number.data() + number.size(), tok->number).ec == std::errc::result_out_of_range)
+                return std::unexpected(fail("Number out of range", span_of(number)));
+            return tok;
         }
-        std::shared_ptr<token> read_ident()
+        CCPP_INLINE result<lexeme> read_ident()
         {
-            std::string id = read_while([&](char ch)
-                                        { return is_id(ch); });
-            return token::create(is_keyword(id) ? "kw" : "var", id);
+            auto id = input.take_run(scan::ident);
+            symbol name;
+            bool kw = lookup_keyword(id, name);
+            auto tok = make(kw ? lexeme_kind::kw : lexeme_kind::var, id);
+            if (tok)
+                tok->name = kw ? name : table->intern(id);
+            return tok;
         }
-        std::string read_escaped(char end)
+        // consumes a quoted run up to the closing quote, escapes are left for
+        // unescape. false when the source ends before the quote is closed
+        bool skip_escaped(char end)
         {
-            bool escaped = false;
-            std::string str = "";
             input.next();
             while (!input.eof())
             {
+                input.take_run([&](const char *p, const char *limit)
+                               { return scan::find_either(p, limit, end, '\\'); });
                 char ch = input.next();
-                if (escaped)
-                {
-                    str += ch;
-                    escaped = false;
-                }
-                else if (ch == '\\')
-                {
-                    escaped = true;
-                }
+                if (ch == '\\')
+                    input.next();
                 else if (ch == end)
-                {
-                    break;
-                }
-                else
-                {
-                    str += ch;
-                }
+                    return true;
             }
-            return str;
+            return false;
         }
-        std::shared_ptr<token> read_string()
+        CCPP_INLINE result<lexeme> read_string()
         {
-            return token::create("string", read_escaped('"'));
+            auto start = input.offset();
+            bool closed = skip_escaped('"');
+            auto text = input.slice(start, input.offset() - start);
+            if (!closed)
+                return std::unexpected(fail("Unterminated string literal", span_of(text)));
+            return make(lexeme_kind::str, text);
         }
         void skip_comment()
         {
-            read_while([&](char ch)
-                       { return ch != '\n'; });
+            input.skip_run([](const char *p, const char *end)
+                           { return scan::find(p, end, '\n'); });
             input.next();
         }
-        std::shared_ptr<token> read_next()
+        CCPP_INLINE result<lexeme> read_op()
         {
-            read_while([&](char ch)
-                       { return is_whitespace(ch); });
-            if (input.eof())
-                return nullptr;
-            char ch = input.peek();
-            if (ch == '#')
+            auto text = read_while([&](char ch)
+                                   { return is_op_char(ch); });
+            auto tok = make(lexeme_kind::op, text);
+            if (tok && !lookup_operator(text, tok->op))
+                return std::unexpected(fail("Unknown operator: " + std::string(text), span_of(text)));
+            return tok;
+        }
+        // the next token, or what was wrong with the text where it should
+        // be. that text is consumed either way, so lexing can go on after it
+        CCPP_INLINE result<lexeme> lex()
+        {
+            input.skip_run(scan::whitespace);
+            while (char_class::is(input.peek(), char_class::comment))
             {
                 skip_comment();
-                return read_next();
+                input.skip_run(scan::whitespace);
             }
-            if (ch == '"')
+            input.mark();
+            if (input.eof())
+                return make(lexeme_kind::eof, std::string_view(input.cursor(), 0));
+            char ch = input.peek();
+            if (char_class::is(ch, char_class::quote))
                 return read_string();
             if (is_digit(ch))
                 return read_number();
             if (is_id_start(ch))
                 return read_ident();
             if (is_punc(ch))
-                return token::create("punc", std::string(1, input.next()));
+            {
+                auto tok = make(lexeme_kind::punc, input.take(input.cursor() + 1));
+                tok->ch = ch;
+                return tok;
+            }
             if (is_op_char(ch))
-                return token::create("op", read_while([&](char ch)
-                                                      { return is_op_char(ch); }));
-            input.croak("Can't handle character: " + std::string(1, ch));
-            return nullptr;
+                return read_op();
+            auto at = static_cast<std::uint32_t>(input.offset());
+            auto problem = fail("Can't handle character: " + std::string(1, ch), {at, at + 1});
+            // the whole utf-8 sequence goes
+            input.next();
+            while ((static_cast<unsigned char>(input.peek()) & 0xc0) == 0x80)
+                input.next();
+            return std::unexpected(problem);
+        }
+        lexeme read_next()
+        {
+            if (replaying)
+                return replay_next();
+            for (;;)
+                if (auto tok = lex())
+                {
+                    CCPP_STATS_COUNT(tokens, 1);
+                    return *tok;
+                }
         }
     };
 
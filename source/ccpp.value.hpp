@@ -0,0 +1,212 @@
+#pragma once
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "ccpp.execption.hpp"
+
+namespace ccpp
+{
+    enum class object_kind : std::uint8_t
+    {
+        string,
+        native,
+        closure, // owned by whichever engine created it
+    };
+
+    // heap part of a value, reference counted by the values that point to it
+    // (single-threaded, cycles through closures are not collected)
+    struct object
+    {
+        std::uint32_t refs = 0;
+        object_kind kind;
+
+        object(object_kind kind) : kind(kind) {}
+        virtual ~object() = default;
+    };
+
+    struct string_object : object
+    {
+        std::string value;
+
+        string_object(std::string value) : object(object_kind::string), value(std::move(value)) {}
+    };
+
+    // runtime value in 64 bits: any double is stored as itself (NaNs are made
+    // canonical), everything else lives in the unused quiet-NaN space above it
+    //   0xFFF9 << 48 | 0/2/3  nil / false / true
+    //   0xFFFA << 48 | int32  integer
+    //   0xFFFC << 48 | ptr    object (48-bit pointer)
+    class value
+    {
+        static constexpr std::uint64_t tag_mask = 0xFFFFull << 48;
+        static constexpr std::uint64_t tag_special = 0xFFF9ull << 48;
+        static constexpr std::uint64_t tag_int = 0xFFFAull << 48;
+        static constexpr std::uint64_t tag_object = 0xFFFCull << 48;
+        static constexpr std::uint64_t nil_bits = tag_special;
+        static constexpr std::uint64_t false_bits = tag_special | 2;
+        static constexpr std::uint64_t true_bits = tag_special | 3;
+        static constexpr std::uint64_t canonical_nan = 0x7FF8000000000000ull;
+
+        std::uint64_t bits = nil_bits;
+
+        void retain() const
+        {
+            if (is_object())
+                as_object()->refs++;
+        }
+        void release() const
+        {
+            if (is_object() && --as_object()->refs == 0)
+                delete as_object();
+        }
+
+    public:
+        value() {}
+        value(bool b) : bits(b ? true_bits : false_bits) {}
+        value(std::int32_t i) : bits(tag_int | static_cast<std::uint32_t>(i)) {}
+        value(double d) : bits(std::isnan(d) ? canonical_nan : std::bit_cast<std::uint64_t>(d)) {}
+        // takes a reference to `obj`, which must come from new
+        value(object *obj) : bits(tag_object | reinterpret_cast<std::uintptr_t>(obj))
+        {
+            obj->refs++;
+        }
+        value(const value &other) : bits(other.bits)
+        {
+            retain();
+        }
+        value(value &&other) noexcept : bits(std::exchange(other.bits, nil_bits)) {}
+        value &operator=(const value &other)
+        {
+            other.retain();
+            release();
+            bits = other.bits;
+            return *this;
+        }
+        value &operator=(value &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                bits = std::exchange(other.bits, nil_bits);
+            }
+            return *this;
+        }
+        ~value()
+        {
+            release();
+        }
+
+        // integral literals become integers, everything else stays a double
+        static value number(double d)
+        {
+            if (d >= -2147483648.0 && d <= 2147483647.0 && d == static_cast<double>(static_cast<std::int32_t>(d)) && !(d == 0 && std::signbit(d)))
+                return value(static_cast<std::int32_t>(d));
+            return value(d);
+        }
+        static value string(std::string str)
+        {
+            return value(new string_object(std::move(str)));
+        }
+
+        bool is_nil() const { return bits == nil_bits; }
+        bool is_bool() const { return (bits | 1) == true_bits; }
+        bool is_int() const { return (bits & tag_mask) == tag_int; }
+        bool is_double() const { return bits < tag_special; }
+        bool is_number() const { return is_double() || is_int(); }
+        bool is_object() const { return (bits & tag_mask) == tag_object; }
+        bool is(object_kind kind) const { return is_object() && as_object()->kind == kind; }
+        bool is_string() const { return is(object_kind::string); }
+
+        bool as_bool() const { return bits == true_bits; }
+        std::int32_t as_int() const { return static_cast<std::int32_t>(static_cast<std::uint32_t>(bits)); }
+        double as_double() const { return std::bit_cast<double>(bits); }
+        double as_number() const { return is_int() ? as_int() : as_double(); }
+        object *as_object() const { return reinterpret_cast<object *>(static_cast<std::uintptr_t>(bits & ~tag_mask)); }
+        std::string_view as_string() const { return static_cast<const string_object *>(as_object())->value; }
+        std::uint64_t raw() const { return bits; }
+        // one test for "both are integers": only then are both high halves the int tag
+        static bool both_int(const value &a, const value &b)
+        {
+            return (((a.bits ^ tag_int) | (b.bits ^ tag_int)) >> 32) == 0;
+        }
+
+        // only false (and nil) are falsy
+        bool truthy() const
+        {
+            return (bits & ~std::uint64_t(2)) != nil_bits;
+        }
+
+        friend bool operator==(const value &a, const value &b)
+        {
+            if (a.bits == b.bits)
+                return !a.is_double() || a.as_double() == a.as_double();
+            if (a.is_number() && b.is_number())
+                return a.as_number() == b.as_number();
+            if (a.is_string() && b.is_string())
+                return a.as_string() == b.as_string();
+            return false;
+        }
+
+        std::string_view type_name() const
+        {
+            if (is_nil())
+                return "nil";
+            if (is_bool())
+                return "bool";
+            if (is_number())
+                return "number";
+            switch (as_object()->kind)
+            {
+            case object_kind::string:
+                return "string";
+            case object_kind::native:
+            case object_kind::closure:
+                return "function";
+            }
+            return "object";
+        }
+        std::string to_string() const
+        {
+            if (is_nil())
+                return "nil";
+            if (is_bool())
+                return as_bool() ? "true" : "false";
+            if (is_number())
+            {
+                char buffer[32];
+                auto result = is_int() ? std::to_chars(buffer, buffer + sizeof(buffer), as_int())
+                                       : std::to_chars(buffer, buffer + sizeof(buffer), as_double());
+                return std::string(buffer, result.ptr);
+            }
+            if (is_string())
+                return std::string(as_string());
+            return "<function>";
+        }
+    };
+    static_assert(sizeof(value) == 8);
+
+    // allocates a heap object and wraps the first reference to it
+    template <typename T, typename... Args>
+    value make_object(Args &&...args)
+    {
+        return value(static_cast<object *>(new T(std::forward<Args>(args)...)));
+    }
+
+    // host function callable from scripts
+    struct native_object : object
+    {
+        std::string name;
+        std::function<value(std::span<const value>)> fn;
+
+        native_object(std::string name, std::function<value(std::span<const value>)> fn)
+            : object(object_kind::native), name(std::move(name)), fn(std::move(fn)) {}
+    };
+} // namespace ccpp
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ccpp.builtins.hpp"
+#include "ccpp.bytecode.hpp"
+#include "ccpp.symbol_table.hpp"
+#include "ccpp.value.hpp"
+
+#if defined(__GNUC__)
+#define CCPP_VM_COMPUTED_GOTO 1
+#endif
+
+namespace ccpp
+{
+    // stack machine for ccpp::program, threaded dispatch where the compiler
+    // supports labels as values and a switch loop elsewhere. arguments stay on
+    // the value stack as the callee's slots, above the callee itself; only
+    // boxed parameters get a heap frame
+    class vm
+    {
+        // the boxed parameters of one activation
+        struct frame
+        {
+            std::shared_ptr<frame> parent;
+            std::vector<value> slots;
+        };
+        struct closure : object
+        {
+            const function_proto *proto;
+            std::shared_ptr<frame> env;
+
+            closure(const function_proto *proto, std::shared_ptr<frame> env) : object(object_kind::closure), proto(proto), env(std::move(env)) {}
+        };
+        struct activation
+        {
+            const function_proto *proto;
+            const std::uint32_t *ip;
+            std::shared_ptr<frame> env;
+            // first slot on the stack, the callee is just below
+            std::size_t base;
+        };
+
+        const ccpp::program &prog;
+        std::shared_ptr<ccpp::symbol_table> symbols;
+        // indexed by symbol id
+        std::vector<value> globals;
+        // one shared closure per function, for lambdas that need no heap frame
+        std::vector<value> functions;
+        std::vector<value> stack;
+        std::vector<activation> calls;
+
+        value pop()
+        {
+            value v = std::move(stack.back());
+            stack.pop_back();
+            return v;
+        }
+        frame *outer(frame *env, std::uint32_t depth)
+        {
+            for (; depth > 0; depth--)
+                env = env->parent.get();
+            return env;
+        }
+        // pads or drops the arguments to the parameter count and makes the heap
+        // frame if the callee boxes any of them
+        std::shared_ptr<frame> enter(const closure &fn, std::size_t argc)
+        {
+            auto params = fn.proto->params;
+            if (argc < params)
+                stack.resize(stack.size() + params - argc, value(false));
+            else
+                stack.resize(stack.size() - (argc - params));
+            allocations.calls++;
+            if (fn.proto->boxed.empty())
+                return fn.env;
+            allocations.frames++;
+            auto env = std::make_shared<frame>();
+            env->parent = fn.env;
+            env->slots.reserve(fn.proto->boxed.size());
+            auto base = stack.size() - params;
+            for (auto slot : fn.proto->boxed)
+                env->slots.push_back(stack[base + slot]);
+            return env;
+        }
+
+    public:
+        std::size_t max_depth = 1 << 20;
+        // heap allocations made for calls, ccpp.bench reports them per call
+        // for the vm/* benchmarks and ccpp.vm --allocs prints them
+        struct counters
+        {
+            std::size_t calls = 0;
+            std::size_t frames = 0;
+            std::size_t closures = 0;
+        } allocations;
+
+        vm(const ccpp::program &prog, std::shared_ptr<ccpp::symbol_table> symbols, std::ostream &out = std::cout)
+            : prog(prog), symbols(std::move(symbols)), globals(this->symbols->size())
+        {
+            functions.reserve(prog.functions.size());
+            for (auto &fn : prog.functions)
+                functions.push_back(make_object<closure>(&fn, nullptr));
+            define_builtins([&](std::string_view name, value v)
+                            { define(name, std::move(v)); },
+                            out);
+        }
+        void define(std::string_view name, value v)
+        {
+            auto id = symbols->intern(name);
+            if (id >= globals.size())
+                globals.resize(symbols->size());
+            globals[id] = std::move(v);
+        }
+
+        value run()
+        {
+            stack.clear();
+            calls.clear();
+            stack.reserve(1024);
+            if (globals.size() < symbols->size())
+                globals.resize(symbols->size());
+
+            const function_proto *fn = &prog.functions[0];
+            const std::uint32_t *ip = fn->code.data();
+            frame *env = nullptr;
+            std::size_t base = 0;
+            calls.push_back({fn, ip, nullptr, 0});
+
+#ifdef CCPP_VM_COMPUTED_GOTO
+            static void *const labels[] = {
+                &&op_constant, &&op_push_true, &&op_push_false, &&op_load_local, &&op_load_up, &&op_load_boxed, &&op_store_local,
+                &&op_store_up, &&op_store_boxed, &&op_load_global, &&op_store_global, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod,
+                &&op_lt, &&op_gt, &&op_le, &&op_ge, &&op_eq, &&op_ne, &&op_jump, &&op_jump_if_false, &&op_and_jump, &&op_or_jump,
+                &&op_pop, &&op_closure, &&op_function, &&op_call, &&op_tail_call, &&op_return_};
+            static_assert(std::size(labels) == static_cast<std::size_t>(opcode::count_));
+#define CCPP_VM_CASE(name) op_##name:
+#define CCPP_VM_NEXT() goto *labels[*ip++]
+            CCPP_VM_NEXT();
+#else
+#define CCPP_VM_CASE(name) case opcode::name:
+#define CCPP_VM_NEXT() continue
+            for (;;)
+                switch (static_cast<opcode>(*ip++))
+                {
+#endif
+// integer operands are handled inline, everything else goes through apply_op
+#define CCPP_VM_BINARY(name, fast)                                             \
+    CCPP_VM_CASE(name)                                                         \
+    {                                                                          \
+        value &left = stack[stack.size() - 2];                                 \
+        if (value::both_int(left, stack.back()))                               \
+        {                                                                      \
+            [[maybe_unused]] std::int64_t a = left.as_int();                   \
+            [[maybe_unused]] std::int64_t b = stack.back().as_int();           \
+            left = fast;                                                       \
+            stack.pop_back();                                                  \
+            CCPP_VM_NEXT();                                                    \
+        }                                                                      \
+        value right = pop();                                                   \
+        stack.back() = apply_op(op_kind::name, stack.back(), right);           \
+        CCPP_VM_NEXT();                                                        \
+    }
+            CCPP_VM_CASE(constant)
+            {
+                stack.push_back(fn->constants[*ip++]);
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(push_true)
+            {
+                stack.push_back(value(true));
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(push_false)
+            {
+                stack.push_back(value(false));
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(load_local)
+            {
+                stack.push_back(stack[base + *ip++]);
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(load_up)
+            {
+                auto &below = calls[calls.size() - 1 - ip[0]];
+                stack.push_back(stack[below.base + ip[1]]);
+                ip += 2;
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(load_boxed)
+            {
+                stack.push_back(outer(env, ip[0])->slots[ip[1]]);
+                ip += 2;
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(store_local)
+            {
+                stack[base + *ip++] = stack.back();
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(store_up)
+            {
+                auto &below = calls[calls.size() - 1 - ip[0]];
+                stack[below.base + ip[1]] = stack.back();
+                ip += 2;
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(store_boxed)
+            {
+                outer(env, ip[0])->slots[ip[1]] = stack.back();
+                ip += 2;
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(load_global)
+            {
+                auto &slot = globals[*ip++];
+                if (slot.is_nil())
+                    throw exception("Undefined variable " + std::string(symbols->name(ip[-1])));
+                stack.push_back(slot);
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(store_global)
+            {
+                globals[*ip++] = stack.back();
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_BINARY(add, int_result(a + b))
+            CCPP_VM_BINARY(sub, int_result(a - b))
+            CCPP_VM_BINARY(mul, int_result(a * b))
+            CCPP_VM_BINARY(div, apply_op(op_kind::div, left, stack.back()))
+            CCPP_VM_BINARY(mod, apply_op(op_kind::mod, left, stack.back()))
+            CCPP_VM_BINARY(lt, value(a < b))
+            CCPP_VM_BINARY(gt, value(a > b))
+            CCPP_VM_BINARY(le, value(a <= b))
+            CCPP_VM_BINARY(ge, value(a >= b))
+            CCPP_VM_BINARY(eq, value(a == b))
+            CCPP_VM_BINARY(ne, value(a != b))
+            CCPP_VM_CASE(jump)
+            {
+                ip = fn->code.data() + *ip;
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(jump_if_false)
+            {
+                auto target = *ip++;
+                if (!pop().truthy())
+                    ip = fn->code.data() + target;
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(and_jump)
+            {
+                auto target = *ip++;
+                if (!pop().truthy())
+                {
+                    stack.push_back(value(false));
+                    ip = fn->code.data() + target;
+                }
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(or_jump)
+            {
+                auto target = *ip++;
+                if (pop().truthy())
+                {
+                    stack.push_back(value(true));
+                    ip = fn->code.data() + target;
+                }
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(pop)
+            {
+                stack.pop_back();
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(closure)
+            {
+                allocations.closures++;
+                stack.push_back(make_object<closure>(&prog.functions[*ip++], calls.back().env));
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(function)
+            {
+                stack.push_back(functions[*ip++]);
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(call)
+            CCPP_VM_CASE(tail_call)
+            {
+                bool tail = static_cast<opcode>(ip[-1]) == opcode::tail_call;
+                auto argc = *ip++;
+                value callee = stack[stack.size() - argc - 1];
+                if (callee.is(object_kind::native))
+                {
+                    auto result = static_cast<native_object *>(callee.as_object())->fn(std::span<const value>(stack.data() + stack.size() - argc, argc));
+                    stack.resize(stack.size() - argc - 1);
+                    stack.push_back(std::move(result));
+                    CCPP_VM_NEXT();
+                }
+                if (!callee.is(object_kind::closure))
+                    throw exception(callee.to_string() + " is not a function");
+                auto &target = *static_cast<closure *>(callee.as_object());
+                auto next = enter(target, argc);
+                auto params = target.proto->params;
+                if (tail)
+                {
+                    // slide callee and arguments down over the current activation
+                    auto from = stack.size() - params - 1;
+                    std::move(stack.begin() + from, stack.end(), stack.begin() + (base - 1));
+                    stack.resize(base + params);
+                    calls.back() = {target.proto, nullptr, std::move(next), base};
+                }
+                else
+                {
+                    if (calls.size() >= max_depth)
+                        throw exception("Stack overflow");
+                    calls.back().ip = ip;
+                    base = stack.size() - params;
+                    calls.push_back({target.proto, nullptr, std::move(next), base});
+                }
+                fn = target.proto;
+                ip = fn->code.data();
+                env = calls.back().env.get();
+                CCPP_VM_NEXT();
+            }
+            CCPP_VM_CASE(return_)
+            {
+                value result = pop();
+                auto done = calls.back().base;
+                calls.pop_back();
+                if (calls.empty())
+                    return result;
+                stack.resize(done - 1);
+                fn = calls.back().proto;
+                ip = calls.back().ip;
+                env = calls.back().env.get();
+                base = calls.back().base;
+                stack.push_back(std::move(result));
+                CCPP_VM_NEXT();
+            }
+#ifndef CCPP_VM_COMPUTED_GOTO
+                default:
+                    throw exception("Bad opcode");
+                }
+#endif
+#undef CCPP_VM_BINARY
+#undef CCPP_VM_NEXT
+#undef CCPP_VM_CASE
+        }
+    };
+} // namespace ccpp
@@ -0,0 +1,53 @@
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#include "ccpp.codegen.hpp"
+#include "ccpp.optimizer.hpp"
+#include "ccpp.parser.hpp"
+
+// ccpp.compile [--no-fold] [-o out.cpp] <script>: translates the script to c++,
+// build the result with ccpp.runtime.hpp on the include path
+int main(int argc, char *argv[])
+{
+    bool fold = true;
+    const char *path = nullptr;
+    const char *output = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string_view(argv[i]) == "--no-fold")
+            fold = false;
+        else if (std::string_view(argv[i]) == "-o" && i + 1 < argc)
+            output = argv[++i];
+        else
+            path = argv[i];
+    }
+    if (path == nullptr)
+    {
+        std::cerr << "usage: ccpp.compile [--no-fold] [-o out.cpp] <script>" << std::endl;
+        return 2;
+    }
+    try
+    {
+        ccpp::input_stream is{ccpp::mapped_file(path)};
+        ccpp::parser p{ccpp::token_stream(is)};
+        auto ast = p.parse();
+        if (fold)
+            ast = ccpp::optimizer(ast).optimize();
+        if (output == nullptr)
+        {
+            ccpp::codegen(ast).generate(std::cout);
+            return 0;
+        }
+        std::ofstream out(output);
+        if (!out)
+            throw ccpp::exception("Can't write " + std::string(output));
+        ccpp::codegen(ast).generate(out);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
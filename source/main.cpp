@@ -1,26 +1,195 @@
 #include <iostream>
 
 #include <map>
+#include <string_view>
 
+#include "ccpp.ast_cache.hpp"
+#include "ccpp.cps.hpp"
+#include "ccpp.evaluator.hpp"
+#include "ccpp.optimizer.hpp"
+#include "ccpp.parallel_lexer.hpp"
+#include "ccpp.parallel_parser.hpp"
 #include "ccpp.parser.hpp"
+#include "ccpp.stats.hpp"
 
-int main()
+CCPP_STATS_ALLOCATION_HOOK()
+
+// ccpp.test [--no-fold] [--cps] [--parallel] [--cache] [--check] [--stats] <script>: runs the
+// script, --cps on the trampolined continuation-passing evaluator instead of the direct one,
+// --parallel lexes and parses it on the thread pool, --cache takes the parsed script from (or
+// writes it to) the .ccppc file next to it, --check only parses it and prints every error found
+// instead of stopping at the first, --stats prints time, tokens, nodes and allocations per phase
+// (in a build with CCPP_STATS, where the script is lexed whole before it is parsed). a script
+// of `-` is read from stdin as it arrives and each statement runs as soon as it has been
+// read. without arguments prints the demo tokens and AST
+int main(int argc, char *argv[])
 {
+    bool fold = true;
+    bool cps = false;
+    bool parallel = false;
+    bool cache = false;
+    bool check = false;
+    bool stats = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string_view(argv[i]) == "--no-fold")
+            fold = false;
+        else if (std::string_view(argv[i]) == "--cps")
+            cps = true;
+        else if (std::string_view(argv[i]) == "--parallel")
+            parallel = true;
+        else if (std::string_view(argv[i]) == "--cache")
+            cache = true;
+        else if (std::string_view(argv[i]) == "--check")
+            check = true;
+        else if (std::string_view(argv[i]) == "--stats")
+            stats = true;
+        else
+            path = argv[i];
+    }
+    if (path != nullptr)
+    {
+        int status = 0;
+        try
+        {
+            // stdin is lexed through a bounded window and never held whole,
+            // so it can't be split up for the parallel front end
+            bool piped = std::string_view(path) == "-";
+            if (check)
+            {
+                auto is = piped ? ccpp::input_stream{ccpp::stream_reader(0)} : ccpp::input_stream{ccpp::mapped_file(path)};
+                ccpp::diagnostics problems;
+                ccpp::parser p{ccpp::token_stream(is)};
+                p.diagnostics = &problems;
+                p.parse();
+                problems.print(std::cerr, path);
+                return problems.errors() > 0 ? 1 : 0;
+            }
+            if (piped && !cps)
+            {
+                // each statement runs once the `;` after it has been read, so
+                // output keeps up with the input and an error stops it there.
+                // the cps evaluator takes the whole script
+                auto symbols = std::make_shared<ccpp::symbol_table>();
+                ccpp::parser p{ccpp::token_stream(ccpp::input_stream{ccpp::stream_reader(0)}, symbols)};
+                ccpp::ast program;
+                program.symbols = symbols;
+                ccpp::evaluator ev(program);
+                for (;;)
+                {
+                    ccpp::ast statement;
+                    {
+                        CCPP_STATS_PHASE(parse);
+                        statement = p.parse_next();
+                    }
+                    if (statement.root == ccpp::no_node)
+                        break;
+                    if (fold)
+                    {
+                        CCPP_STATS_PHASE(optimize);
+                        statement = ccpp::optimizer(statement).optimize();
+                    }
+                    CCPP_STATS_PHASE(run);
+                    ev.run(statement);
+                    // for whatever reads the output through a pipe
+                    std::cout.flush();
+                }
+            }
+            else
+            {
+                ccpp::ast ast;
+                if (cache && !piped)
+                {
+                    CCPP_STATS_PHASE(parse);
+                    ast = ccpp::ast_cache::parse(path);
+                }
+                else
+                {
+                    auto is = [&]()
+                    {
+                        CCPP_STATS_PHASE(read);
+                        return piped ? ccpp::input_stream{ccpp::stream_reader(0)} : ccpp::input_stream{ccpp::mapped_file(path)};
+                    }();
+                    if (parallel && !piped)
+                    {
+                        ccpp::parallel_lexer lexer(is);
+                        std::vector<ccpp::lexeme> tokens;
+                        {
+                            CCPP_STATS_PHASE(lex);
+                            tokens = lexer.lex();
+                        }
+                        CCPP_STATS_PHASE(parse);
+                        ast = ccpp::parallel_parser(is, std::move(tokens), lexer.symbols()).parse();
+                    }
+#ifdef CCPP_STATS
+                    else if (stats && !piped)
+                    {
+                        // lexed up front so the phases can be told apart
+                        auto symbols = std::make_shared<ccpp::symbol_table>();
+                        std::vector<ccpp::lexeme> tokens;
+                        std::size_t end;
+                        {
+                            CCPP_STATS_PHASE(lex);
+                            ccpp::token_stream ts(is, symbols);
+                            while (!ts.eof())
+                                tokens.push_back(ts.next());
+                            end = ts.peek().offset;
+                        }
+                        CCPP_STATS_PHASE(parse);
+                        ast = ccpp::parser{ccpp::token_stream(is, tokens, end, symbols)}.parse();
+                    }
+#endif
+                    else
+                    {
+                        CCPP_STATS_PHASE(parse);
+                        ast = ccpp::parser{ccpp::token_stream(is)}.parse();
+                    }
+                }
+                if (fold)
+                {
+                    CCPP_STATS_PHASE(optimize);
+                    ast = ccpp::optimizer(ast).optimize();
+                }
+                CCPP_STATS_PHASE(run);
+                if (cps)
+                    ccpp::cps_evaluator(ast).run();
+                else
+                    ccpp::evaluator(ast).run();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+        if (stats)
+        {
+#ifdef CCPP_STATS
+            ccpp::stats::snapshot().print(std::cerr);
+#else
+            std::cerr << "--stats needs a build with CCPP_STATS (cmake -DCCPP_STATS=ON)" << std::endl;
+#endif
+        }
+        return status;
+    }
     {
         ccpp::input_stream is("if (a == 2) { return 3; } else { return 4; }");
         ccpp::token_stream ts(is);
         while (!ts.eof())
         {
             auto tok = ts.next();
-            std::cout << tok->type << " : " << *tok << std::endl;
+            std::cout << ccpp::to_string(tok.kind) << " : " << ts.text(tok) << std::endl;
         }
     }
     ccpp::input_stream is("a = 2;");
     ccpp::token_stream ts(is);
     ccpp::parser p(ts);
 
-    auto ast = p.parse(ts);
-    std::cout << "AST: " << ast->type << std::endl;
+    auto ast = p.parse();
+    std::cout << "AST: ";
+    ast.dump(std::cout, ast.root);
+    std::cout << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
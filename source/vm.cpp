@@ -0,0 +1,96 @@
+#include <iostream>
+#include <string_view>
+
+#include "ccpp.ast_cache.hpp"
+#include "ccpp.compiler.hpp"
+#include "ccpp.optimizer.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.stats.hpp"
+#include "ccpp.vm.hpp"
+
+CCPP_STATS_ALLOCATION_HOOK()
+
+// ccpp.vm [--disasm] [--no-fold] [--allocs] [--cache] [--stats] <script>: compiles the script
+// to bytecode and runs it, --allocs reports the heap allocations made for calls, --cache
+// takes the parsed script from (or writes it to) the .ccppc file next to it, --stats prints
+// time, tokens, nodes and allocations per phase (in a build with CCPP_STATS)
+int main(int argc, char *argv[])
+{
+    bool disasm = false;
+    bool fold = true;
+    bool allocs = false;
+    bool cache = false;
+    bool stats = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string_view(argv[i]) == "--disasm")
+            disasm = true;
+        else if (std::string_view(argv[i]) == "--no-fold")
+            fold = false;
+        else if (std::string_view(argv[i]) == "--allocs")
+            allocs = true;
+        else if (std::string_view(argv[i]) == "--cache")
+            cache = true;
+        else if (std::string_view(argv[i]) == "--stats")
+            stats = true;
+        else
+            path = argv[i];
+    }
+    if (path == nullptr)
+    {
+        std::cerr << "usage: ccpp.vm [--disasm] [--no-fold] [--allocs] [--cache] [--stats] <script>" << std::endl;
+        return 2;
+    }
+    int status = 0;
+    try
+    {
+        ccpp::ast ast;
+        {
+            CCPP_STATS_PHASE(parse);
+            ast = cache ? ccpp::ast_cache::parse(path) : ccpp::parser{ccpp::token_stream(ccpp::input_stream{ccpp::mapped_file(path)})}.parse();
+        }
+        if (fold)
+        {
+            CCPP_STATS_PHASE(optimize);
+            ast = ccpp::optimizer(ast).optimize();
+        }
+        ccpp::program prog;
+        {
+            CCPP_STATS_PHASE(compile);
+            prog = ccpp::compiler(ast).compile();
+        }
+        if (disasm)
+        {
+            prog.disassemble(std::cout);
+            return 0;
+        }
+        ccpp::vm machine(prog, ast.symbols);
+        {
+            CCPP_STATS_PHASE(run);
+            machine.run();
+        }
+        if (allocs)
+        {
+            auto &count = machine.allocations;
+            auto per_call = [&](std::size_t n)
+            { return count.calls == 0 ? 0.0 : double(n) / double(count.calls); };
+            std::cerr << "calls " << count.calls << ", frames " << count.frames << " (" << per_call(count.frames)
+                      << "/call), closures " << count.closures << " (" << per_call(count.closures) << "/call)" << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+    if (stats)
+    {
+#ifdef CCPP_STATS
+        ccpp::stats::snapshot().print(std::cerr);
+#else
+        std::cerr << "--stats needs a build with CCPP_STATS (cmake -DCCPP_STATS=ON)" << std::endl;
+#endif
+    }
+    return status;
+}
@@ -0,0 +1,108 @@
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "ccpp.ast_cache.hpp"
+#include "ccpp.evaluator.hpp"
+
+// ast_cache test: a cache file with any one byte flipped either loads as a tree the
+// evaluator can run (or fail on) without crashing, or is a miss after which the
+// script is parsed again and prints what it should. takes a directory to work in
+namespace
+{
+    // no recursion, so whatever a flipped number or name turns it into ends quickly
+    const std::string_view script = R"(# a bit of everything
+greet = lambda(name) "hello, " + name;
+twice = lambda(f, x) f(f(x));
+inc = lambda(n) n + 1;
+flag = true && false || 1 < 2;
+println(greet("cache"), " ", twice(inc, 40), " ", flag);
+pick = lambda(c) if c then { "yes" } else "no";
+println(pick(1 >= 2), pick(3 != 4), 0 - 2.5 * 4 % 3, "tab\tquote\"");
+)";
+
+    // what running `tree` prints, ending with the error that stopped it if any
+    std::string output(ccpp::ast &tree)
+    {
+        std::ostringstream out;
+        try
+        {
+            ccpp::evaluator(tree, out).run();
+        }
+        catch (const ccpp::exception &e)
+        {
+            out << "error: " << e.what() << std::endl;
+        }
+        return out.str();
+    }
+
+    std::string read(const std::filesystem::path &file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+    void write(const std::filesystem::path &file, std::string_view bytes)
+    {
+        std::ofstream(file, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        std::cout << "usage: ccpp.ast_cache_test <directory>" << std::endl;
+        return 2;
+    }
+    std::filesystem::path dir = argv[1];
+    std::filesystem::create_directories(dir);
+    auto path = dir / "script.ccpp";
+    write(path, script);
+    auto cache = ccpp::ast_cache::path_for(path);
+    std::filesystem::remove(cache);
+
+    auto parsed = ccpp::ast_cache::parse(path);
+    auto expected = output(parsed);
+    auto pristine = read(cache);
+    auto hash = ccpp::source_hash(script);
+    int failures = 0;
+    ccpp::ast tree;
+    if (!ccpp::ast_cache::load(cache, hash, script.size(), tree) || output(tree) != expected)
+    {
+        std::cout << "the cache written for the script doesn't load as the same program" << std::endl;
+        failures++;
+    }
+
+    std::size_t loaded = 0, missed = 0;
+    for (std::size_t at = 0; at < pristine.size(); at++)
+        for (unsigned char mask : {0x01, 0x80, 0xff})
+        {
+            auto bytes = pristine;
+            bytes[at] = static_cast<char>(bytes[at] ^ mask);
+            write(cache, bytes);
+            if (ccpp::ast_cache::load(cache, hash, script.size(), tree))
+            {
+                // a number, a name or a span can change to another that fits;
+                // running it must not crash, what it prints is anyone's guess
+                output(tree);
+                loaded++;
+                continue;
+            }
+            missed++;
+            auto again = ccpp::ast_cache::parse(path);
+            if (auto actual = output(again); actual != expected)
+            {
+                std::cout << "byte " << at << " ^ " << int(mask) << ": parsed again it printed\n"
+                          << actual << "instead of\n"
+                          << expected;
+                failures++;
+            }
+        }
+    std::cout << pristine.size() << " bytes flipped 3 ways: " << loaded << " loaded, " << missed << " parsed again" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
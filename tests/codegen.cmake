@@ -0,0 +1,27 @@
+# cmake -DINTERPRETER=ccpp.test -DCOMPILE=ccpp.compile -DCXX=c++ -DCXX_FLAGS=-std=c++23
+#       -DINCLUDE=source -DSCRIPT=x.ccpp -DWORK=dir -P codegen.cmake
+# runs SCRIPT on the interpreter, translates it with ccpp.compile, builds the c++ with
+# the runtime header and fails unless the program prints the same and exits the same way
+get_filename_component(name "${SCRIPT}" NAME_WE)
+file(MAKE_DIRECTORY "${WORK}")
+set(generated "${WORK}/${name}.cpp")
+set(program "${WORK}/${name}")
+
+execute_process(COMMAND "${INTERPRETER}" "${SCRIPT}" OUTPUT_VARIABLE expected RESULT_VARIABLE expected_status)
+execute_process(COMMAND "${COMPILE}" -o "${generated}" "${SCRIPT}" RESULT_VARIABLE status ERROR_VARIABLE error)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "ccpp.compile failed on ${SCRIPT}: ${error}")
+endif()
+separate_arguments(flags NATIVE_COMMAND "${CXX_FLAGS}")
+execute_process(COMMAND "${CXX}" ${flags} -O1 "-I${INCLUDE}" "${generated}" -o "${program}" RESULT_VARIABLE status ERROR_VARIABLE error)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${generated} does not build: ${error}")
+endif()
+execute_process(COMMAND "${program}" OUTPUT_VARIABLE actual RESULT_VARIABLE actual_status)
+
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "${name}: the compiled program printed\n${actual}\nthe interpreter printed\n${expected}")
+endif()
+if(NOT actual_status EQUAL expected_status)
+    message(FATAL_ERROR "${name}: the compiled program exited with ${actual_status}, the interpreter with ${expected_status}")
+endif()
@@ -0,0 +1,45 @@
+# cmake -DINTERPRETER=ccpp.test -DVM=ccpp.vm -DWORK=dir -P depth.cmake
+# deep programs must either run or be rejected with an error, never overflow
+# the native stack, on every path from the parser to the evaluators
+file(MAKE_DIRECTORY "${WORK}")
+
+# runs the program in `source` on each of the remaining arguments (a command
+# line with , between words) and checks it exits 0 printing `output`, or if
+# `output` is empty, exits 1 with an error
+function(expect name source output)
+    set(script "${WORK}/${name}.ccpp")
+    file(WRITE "${script}" "${source}")
+    foreach(line ${ARGN})
+        string(REPLACE "," ";" command "${line}")
+        execute_process(COMMAND ${command} "${script}" OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE status)
+        if(output STREQUAL "")
+            if(NOT status EQUAL 1 OR error STREQUAL "")
+                message(FATAL_ERROR "${name}: `${line}` exited with ${status} instead of reporting an error")
+            endif()
+        elseif(NOT status EQUAL 0 OR NOT actual STREQUAL output)
+            message(FATAL_ERROR "${name}: `${line}` exited with ${status} printing\n${actual}${error}")
+        endif()
+    endforeach()
+endfunction()
+
+set(all "${INTERPRETER}" "${INTERPRETER},--no-fold" "${INTERPRETER},--cps" "${VM}" "${VM},--no-fold")
+
+string(REPEAT " + x" 50000 terms)
+expect(long_chain "x = 1;\nprintln(x${terms});\n" "" ${all})
+string(REPEAT "(" 200000 open)
+expect(deep_parens "println(${open}1);\n" "" ${all} "${INTERPRETER},--check")
+string(REPEAT "{" 200000 open)
+expect(deep_braces "println(${open}1);\n" "" ${all} "${INTERPRETER},--check")
+
+# as deep as the parser lets through
+string(REPEAT " + x" 4000 terms)
+expect(chain "x = 1;\nprintln(x${terms});\n" "4001\n" "${INTERPRETER}" "${INTERPRETER},--no-fold" "${VM}" "${VM},--no-fold")
+string(REPEAT "(" 4000 open)
+string(REPEAT ")" 4000 close)
+expect(parens "println(${open}1${close});\n" "1\n" ${all})
+string(REPEAT " + f(1)" 1500 terms)
+expect(call_chain "f = lambda(x) x;\nprintln(f(1)${terms});\n" "1501\n" ${all})
+
+set(sum "sum = lambda(n, acc) if n == 0 then acc else sum(n - 1, acc + n);\n")
+expect(recursion "${sum}println(sum(8000, 0));\n" "32004000\n" "${INTERPRETER}" "${INTERPRETER},--no-fold" "${VM}")
+expect(runaway "${sum}println(sum(1000000, 0));\n" "" "${INTERPRETER}" "${INTERPRETER},--no-fold")
@@ -0,0 +1,34 @@
+# cmake -DINTERPRETER=ccpp.test -DWORK=dir -P diagnostics.cmake
+# errors are located where the text they are about starts, not where the reader
+# got to, say what they found, and an unterminated string is one of them
+file(MAKE_DIRECTORY "${WORK}")
+
+set(script "${WORK}/errors.ccpp")
+file(WRITE "${script}" "x = (1 +   ;\ny = )  # the ) is the problem\n;\nz = 1 $;\nprintln(\"fine\");\nw = \"never closed;\nprintln(w);\n")
+set(expected "${script}:1:11: error: Unexpected token: punc \";\"
+${script}:2:4: error: Unexpected token: punc \")\"
+${script}:4:6: error: Can't handle character: $
+${script}:6:4: error: Unterminated string literal
+${script}:8:0: error: Unexpected end of input
+")
+execute_process(COMMAND "${INTERPRETER}" --check "${script}" OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE status)
+if(NOT status EQUAL 1 OR NOT error STREQUAL expected)
+    message(FATAL_ERROR "--check exited with ${status} printing\n${output}${error}instead of\n${expected}")
+endif()
+
+# run without --check it is thrown, from a file or piped in
+set(one "${WORK}/one.ccpp")
+file(WRITE "${one}" "x = 1;\ny = (x +   ;\nprintln(y);\n")
+foreach(flags "" "--parallel" "--cps")
+    execute_process(COMMAND "${INTERPRETER}" ${flags} "${one}" OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE status)
+    if(NOT status EQUAL 1 OR NOT error STREQUAL "Unexpected token: punc \";\" (2:11)\n")
+        message(FATAL_ERROR "with `${flags}` it exited with ${status} printing\n${output}${error}")
+    endif()
+endforeach()
+
+set(unterminated "${WORK}/unterminated.ccpp")
+file(WRITE "${unterminated}" "println(\"before\");\nprintln(\"after\n")
+execute_process(COMMAND "${INTERPRETER}" - INPUT_FILE "${unterminated}" OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE status)
+if(NOT status EQUAL 1 OR NOT output STREQUAL "before\n" OR NOT error STREQUAL "Unterminated string literal (2:8)\n")
+    message(FATAL_ERROR "piped in it exited with ${status} printing\n${output}${error}")
+endif()
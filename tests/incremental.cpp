@@ -0,0 +1,118 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.corpus.hpp"
+#include "ccpp.incremental.hpp"
+#include "ccpp.parser.hpp"
+#include "tree.hpp"
+
+// incremental_parser test: after every one of a run of random edits, the text, whether
+// it parses, and the tree or the error are what a fresh parser gives for the edited text.
+// each edit is undone at random later, so the source keeps coming back to parsing
+namespace
+{
+    const std::string_view program = R"(# a few of everything
+f = lambda(x) { a = x; b = x * 2; a + b };
+g = lambda() if f(1) > 2 then { "big; {"; } else { "small" };
+println(f(1), g());
+x = { y = 1; { z = y; z } };
+s = "a string
+over lines # with a hash";
+h = lambda(n) if n < 2 then n else h(n - 1) + h(n - 2);
+)";
+
+    // pieces of the language an edit inserts, most of them unbalanced
+    const std::string_view pieces[] = {
+        "", " ", "\n", ";", "{", "}", "(", ")", "\"", "#", "# note\n", "\\", "x", "1", " + ", "lambda(a) { a; }",
+        "if x then 1 else 2", "; y = 2;", "{ q = 1; }", "\"text\"", "==", "$",
+    };
+
+    struct edit
+    {
+        std::size_t offset;
+        std::size_t removed;
+        std::string inserted;
+    };
+
+    // what went wrong comparing `inc` with a fresh parse of `text`, or empty
+    std::string compare(const ccpp::incremental_parser &inc, const std::string &text)
+    {
+        if (inc.text() != text)
+            return "the text differs";
+        std::string error;
+        ccpp::ast expected;
+        try
+        {
+            expected = ccpp::parser{ccpp::token_stream(ccpp::input_stream(std::string_view(text)))}.parse();
+        }
+        catch (const ccpp::exception &e)
+        {
+            error = e.what();
+        }
+        if (inc.valid() != error.empty())
+            return error.empty() ? "it says the source doesn't parse" : "it says the source parses, the parser says " + error;
+        if (!error.empty())
+        {
+            try
+            {
+                inc.tree();
+            }
+            catch (const ccpp::exception &e)
+            {
+                if (e.what() != error)
+                    return std::string("it reports ") + e.what() + " instead of " + error;
+                return {};
+            }
+            return "it builds a tree from a source that doesn't parse";
+        }
+        return test::compare(expected, inc.tree());
+    }
+} // namespace
+
+int main()
+{
+    int failures = 0;
+    std::vector<std::pair<std::string, std::string>> sources = {{"program", std::string(program)}};
+    for (auto &gen : ccpp::corpus::generators)
+        sources.emplace_back(gen.name, gen.make(4 << 10, 1));
+    for (auto &[name, source] : sources)
+    {
+        std::mt19937 rng(7);
+        ccpp::incremental_parser inc(source);
+        auto text = source;
+        // inverses of the edits made so far, the last one on top
+        std::vector<edit> undo;
+        for (int step = 0; step < 2000; step++)
+        {
+            edit e;
+            // mostly undoing while the source doesn't parse keeps it near one that does
+            if (!undo.empty() && rng() % 4 < (inc.valid() ? 1u : 3u))
+            {
+                e = undo.back();
+                undo.pop_back();
+            }
+            else
+            {
+                e.offset = rng() % (text.size() + 1);
+                e.removed = std::min<std::size_t>(rng() % 4, text.size() - e.offset);
+                e.inserted = pieces[rng() % std::size(pieces)];
+                undo.push_back({e.offset, e.inserted.size(), text.substr(e.offset, e.removed)});
+            }
+            text.replace(e.offset, e.removed, e.inserted);
+            inc.edit({e.offset, e.removed, e.inserted});
+            if (auto problem = compare(inc, text); !problem.empty())
+            {
+                std::cout << name << ", edit " << step << " (" << e.removed << " bytes at " << e.offset << " replaced by `"
+                          << e.inserted << "`): " << problem << std::endl;
+                failures++;
+                break;
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
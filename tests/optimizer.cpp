@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.corpus.hpp"
+#include "ccpp.evaluator.hpp"
+#include "ccpp.optimizer.hpp"
+#include "ccpp.parser.hpp"
+
+// optimizer test: the optimized trees of the corpus scripts have fewer nodes than the
+// parse (and never more), and every node in them still has a span into the source.
+// the scripts in the directory given on the command line print the same folded or not
+namespace
+{
+    // what running `source` prints, ending with the error that stopped it if any
+    std::string output(const std::string &source, bool fold)
+    {
+        std::ostringstream out;
+        try
+        {
+            auto tree = ccpp::parser{ccpp::token_stream(ccpp::input_stream(std::string_view(source)))}.parse();
+            if (fold)
+                tree = ccpp::optimizer(tree).optimize();
+            ccpp::evaluator(tree, out).run();
+        }
+        catch (const std::exception &e)
+        {
+            out << "error: " << e.what() << std::endl;
+        }
+        return out.str();
+    }
+
+    // the first node with no span under `id`, or no_node
+    ccpp::node_id unplaced(const ccpp::ast &tree, ccpp::node_id id)
+    {
+        if (id == ccpp::no_node)
+            return ccpp::no_node;
+        if (tree.at(id).span.end == 0)
+            return id;
+        auto first = [&](auto children)
+        {
+            for (auto child : children)
+                if (auto found = unplaced(tree, child); found != ccpp::no_node)
+                    return found;
+            return ccpp::no_node;
+        };
+        switch (tree.kind(id))
+        {
+        case ccpp::node_kind::assign_t:
+        case ccpp::node_kind::binary_t:
+        {
+            auto &n = tree.get<ccpp::binary_node>(id);
+            auto found = unplaced(tree, n.left);
+            return found != ccpp::no_node ? found : unplaced(tree, n.right);
+        }
+        case ccpp::node_kind::call_t:
+        {
+            auto found = unplaced(tree, tree.get<ccpp::call_node>(id).func);
+            return found != ccpp::no_node ? found : first(tree.children<ccpp::call_node>(id));
+        }
+        case ccpp::node_kind::if_t:
+        {
+            auto &n = tree.get<ccpp::if_node>(id);
+            for (auto child : {n.cond, n.then, n.else_})
+                if (auto found = unplaced(tree, child); found != ccpp::no_node)
+                    return found;
+            return ccpp::no_node;
+        }
+        case ccpp::node_kind::lambda_t:
+        {
+            auto found = first(tree.children<ccpp::lambda_node>(id));
+            return found != ccpp::no_node ? found : unplaced(tree, tree.get<ccpp::lambda_node>(id).body);
+        }
+        case ccpp::node_kind::prog_t:
+            return first(tree.children<ccpp::prog_node>(id));
+        default:
+            return ccpp::no_node;
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    for (auto &gen : ccpp::corpus::generators)
+    {
+        auto source = gen.make(64 << 10, 1);
+        auto tree = ccpp::parser{ccpp::token_stream(ccpp::input_stream(std::string_view(source)))}.parse();
+        auto optimized = ccpp::optimizer(tree).optimize();
+        std::cout << gen.name << ": " << tree.nodes() << " -> " << optimized.nodes() << " nodes" << std::endl;
+        // the other scripts have no literal operands or nested blocks to fold
+        bool foldable = gen.name == "deep_nesting" || gen.name == "operator_chains";
+        if (foldable ? optimized.nodes() >= tree.nodes() : optimized.nodes() > tree.nodes())
+        {
+            std::cout << "  FAILED: the optimizer " << (foldable ? "removed no nodes" : "added nodes") << std::endl;
+            failures++;
+        }
+        if (auto id = unplaced(optimized, optimized.root); id != ccpp::no_node)
+        {
+            std::cout << "  FAILED: a " << ccpp::to_string(optimized.kind(id)) << " node has no span" << std::endl;
+            failures++;
+        }
+    }
+    std::vector<std::filesystem::path> scripts;
+    for (int i = 1; i < argc; i++)
+        for (auto &entry : std::filesystem::directory_iterator(argv[i]))
+            if (entry.path().extension() == ".ccpp")
+                scripts.push_back(entry.path());
+    std::sort(scripts.begin(), scripts.end());
+    for (auto &path : scripts)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string source(std::istreambuf_iterator<char>(in), {});
+        auto folded = output(source, true);
+        auto unfolded = output(source, false);
+        std::cout << path.filename().string() << ": " << folded.size() << " bytes of output" << std::endl;
+        if (folded != unfolded)
+        {
+            std::cout << "  FAILED: folded it printed\n" << folded << "  unfolded\n" << unfolded;
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccpp.corpus.hpp"
+#include "ccpp.parallel_lexer.hpp"
+#include "ccpp.thread_pool.hpp"
+#include "ccpp.token_stream.hpp"
+
+// parallel_lexer test: with chunks small enough to cut every few lines, the tokens
+// and the names they intern are the ones draining a token_stream gives, also where
+// a chunk starts inside a string or what looks like a comment from there
+namespace
+{
+    // strings running over several lines, with quotes and # on the lines inside
+    // them and in the comments around them
+    const std::string_view tricky = R"(# a comment with "a quote
+a = "first line
+# not a comment, the string goes on
+second " + b;
+# "a comment" with # and " in it
+c = "# a string that looks like a comment
+\" still the string # \\
+";
+d = 1 + 2; # trailing "comment
+e = "
+"; f = "";
+# the last line is a comment "
+)";
+
+    bool same(const ccpp::lexeme &a, const ccpp::symbol_table &as, const ccpp::lexeme &b, const ccpp::symbol_table &bs)
+    {
+        if (a.kind != b.kind || a.offset != b.offset || a.length != b.length)
+            return false;
+        switch (a.kind)
+        {
+        case ccpp::lexeme_kind::num:
+            return a.number == b.number;
+        case ccpp::lexeme_kind::punc:
+            return a.ch == b.ch;
+        case ccpp::lexeme_kind::op:
+            return a.op == b.op;
+        case ccpp::lexeme_kind::kw:
+            return a.name == b.name;
+        case ccpp::lexeme_kind::var:
+            // ids too, the parallel lexer promises first-seen order
+            return a.name == b.name && as.name(a.name) == bs.name(b.name);
+        default:
+            return true;
+        }
+    }
+
+    // what went wrong lexing `source` in chunks of `min_chunk`, or empty
+    std::string compare(std::string_view source, std::size_t min_chunk, ccpp::thread_pool &pool)
+    {
+        auto expected_symbols = std::make_shared<ccpp::symbol_table>();
+        std::vector<ccpp::lexeme> expected;
+        ccpp::token_stream ts(ccpp::input_stream(source), expected_symbols);
+        while (!ts.eof())
+            expected.push_back(ts.next());
+        expected.push_back(ts.next());
+
+        ccpp::parallel_lexer lexer(ccpp::input_stream(source), std::make_shared<ccpp::symbol_table>(), pool);
+        lexer.min_chunk = min_chunk;
+        auto actual = lexer.lex();
+        for (std::size_t i = 0; i < expected.size() && i < actual.size(); i++)
+            if (!same(expected[i], *expected_symbols, actual[i], *lexer.symbols()))
+                return "token " + std::to_string(i) + " at " + std::to_string(expected[i].offset) + " differs";
+        if (expected.size() != actual.size())
+            return std::to_string(actual.size()) + " tokens instead of " + std::to_string(expected.size());
+        return {};
+    }
+} // namespace
+
+int main()
+{
+    int failures = 0;
+    auto check = [&](std::string_view name, std::string_view source, std::size_t min_chunk, ccpp::thread_pool &pool)
+    {
+        if (auto problem = compare(source, min_chunk, pool); !problem.empty())
+        {
+            std::cout << name << " in chunks of " << min_chunk << " on " << pool.size() << " workers: " << problem << std::endl;
+            failures++;
+        }
+    };
+    for (std::size_t workers : {1, 2, 4})
+    {
+        ccpp::thread_pool pool(workers);
+        // every line break of the tricky source becomes a chunk boundary at some size
+        for (std::size_t min_chunk = 1; min_chunk <= tricky.size(); min_chunk++)
+            check("tricky", tricky, min_chunk, pool);
+        for (auto &gen : ccpp::corpus::generators)
+        {
+            auto source = gen.make(64 << 10, 1);
+            for (std::size_t min_chunk : {64, 1000, 4096})
+                check(gen.name, source, min_chunk, pool);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
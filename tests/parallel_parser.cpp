@@ -0,0 +1,60 @@
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "ccpp.corpus.hpp"
+#include "ccpp.parallel_lexer.hpp"
+#include "ccpp.parallel_parser.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.thread_pool.hpp"
+#include "tree.hpp"
+
+// parallel_parser test: with runs of a few statements each, the tree has as many nodes
+// as the sequential parse and, walked in order, the same kinds, spans and payloads
+namespace
+{
+    // statements with `;` inside braces, which must not end a run, and a trailing `;`
+    const std::string_view tricky = R"(f = lambda(x) { a = x; b = x * 2; a + b };
+g = lambda() if f(1) > 2 then { "big"; } else { "small" };
+println(f(1), g());
+x = { y = 1; { z = y; z } };
+)";
+
+    // what went wrong parsing `source` in runs of `min_batch` tokens, or empty
+    std::string compare(std::string_view source, std::size_t min_batch, ccpp::thread_pool &pool)
+    {
+        auto expected = ccpp::parser{ccpp::token_stream(ccpp::input_stream(source))}.parse();
+        ccpp::parallel_lexer lexer(ccpp::input_stream(source), std::make_shared<ccpp::symbol_table>(), pool);
+        ccpp::parallel_parser parser(ccpp::input_stream(source), lexer.lex(), lexer.symbols(), pool);
+        parser.min_batch = min_batch;
+        return test::compare(expected, parser.parse());
+    }
+} // namespace
+
+int main()
+{
+    int failures = 0;
+    auto check = [&](std::string_view name, std::string_view source, std::size_t min_batch, ccpp::thread_pool &pool)
+    {
+        if (auto problem = compare(source, min_batch, pool); !problem.empty())
+        {
+            std::cout << name << " in runs of " << min_batch << " on " << pool.size() << " workers: " << problem << std::endl;
+            failures++;
+        }
+    };
+    for (std::size_t workers : {1, 2, 4})
+    {
+        ccpp::thread_pool pool(workers);
+        for (std::size_t min_batch : {1, 2, 3, 5, 8, 13})
+            check("tricky", tricky, min_batch, pool);
+        for (auto &gen : ccpp::corpus::generators)
+        {
+            auto source = gen.make(64 << 10, 1);
+            for (std::size_t min_batch : {1, 64, 1000})
+                check(gen.name, source, min_batch, pool);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "ccpp.corpus.hpp"
+#include "ccpp.parser.hpp"
+#include "ccpp.stats.hpp"
+
+// stats test, built with CCPP_STATS: the allocation hook counts the plain and the
+// aligned operator new, a parse, whose tree grows through the aligned one, is
+// charged at least the bytes its tree holds, and one from a monotonic buffer big
+// enough for it isn't charged anything
+CCPP_STATS_ALLOCATION_HOOK()
+
+namespace
+{
+    struct alignas(64) wide
+    {
+        char bytes[64];
+    };
+    // the allocations go through here, so the compiler can't leave them out
+    void *volatile sink;
+
+    // what the parse phase counted parsing `source` from `resource`, and how
+    // much the tree holds
+    std::pair<ccpp::stats::phase_report, std::size_t> parse(std::string_view source, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+    {
+        ccpp::stats::reset();
+        std::size_t held = 0;
+        {
+            CCPP_STATS_PHASE(parse);
+            auto tree = ccpp::parser{ccpp::token_stream(ccpp::input_stream(source), resource)}.parse();
+            held = tree.bytes();
+        }
+        return {ccpp::stats::snapshot()[ccpp::stats::phase::parse], held};
+    }
+} // namespace
+
+int main()
+{
+    using ccpp::stats::counter;
+    int failures = 0;
+
+    ccpp::stats::reset();
+    {
+        CCPP_STATS_PHASE(run);
+        sink = new int(1);
+        delete static_cast<int *>(sink);
+        sink = new wide{};
+        delete static_cast<wide *>(sink);
+        sink = new wide[2];
+        delete[] static_cast<wide *>(sink);
+    }
+    auto run = ccpp::stats::snapshot()[ccpp::stats::phase::run];
+    if (run[counter::allocations] != 3 || run[counter::bytes] != sizeof(int) + 3 * sizeof(wide))
+    {
+        std::cout << "an int, an over-aligned struct and an array of two counted as " << run[counter::allocations] << " allocations of "
+                  << run[counter::bytes] << " bytes" << std::endl;
+        failures++;
+    }
+
+    std::size_t last = 0;
+    for (std::size_t size : {1 << 10, 64 << 10, 1 << 20})
+        for (auto &gen : ccpp::corpus::generators)
+        {
+            auto source = gen.make(size, 1);
+            auto [counted, held] = parse(source);
+            if (counted[counter::nodes] == 0 || counted[counter::bytes] < held || counted[counter::allocations] < 2)
+            {
+                std::cout << gen.name << " at " << size << " bytes: " << counted[counter::nodes] << " nodes holding " << held
+                          << " bytes counted as " << counted[counter::allocations] << " allocations of "
+                          << counted[counter::bytes] << " bytes" << std::endl;
+                failures++;
+            }
+            if (&gen == &ccpp::corpus::generators[0])
+            {
+                // a larger source grows the tree more times
+                if (counted[counter::allocations] <= last)
+                {
+                    std::cout << gen.name << " at " << size << " bytes: " << counted[counter::allocations]
+                              << " allocations, no more than at the size before" << std::endl;
+                    failures++;
+                }
+                last = counted[counter::allocations];
+            }
+            // from a buffer the whole parse fits in, the tree's old blocks
+            // included, the heap isn't asked for anything
+            auto capacity = 32 * source.size() + (1 << 20);
+            auto buffer = std::make_unique_for_overwrite<std::byte[]>(capacity);
+            std::pmr::monotonic_buffer_resource arena(buffer.get(), capacity);
+            if (auto from_arena = parse(source, &arena).first; from_arena[counter::allocations] != 0)
+            {
+                std::cout << gen.name << " at " << size << " bytes: " << from_arena[counter::allocations]
+                          << " allocations parsing from a monotonic buffer" << std::endl;
+                failures++;
+            }
+        }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+# cmake -DINTERPRETER=ccpp.test -DWORK=dir -P stdin.cmake
+# a script piped in as `-`, several times the size of the window stdin is read
+# through, prints what it prints run from a file, and the statements before a
+# syntax error run before it is reported
+file(MAKE_DIRECTORY "${WORK}")
+
+set(head "count = 0;\nadd = lambda(n) lambda(x) x + n;\nplus = add(1000);\n")
+string(REPEAT "count = count + 1; println(\"line \", plus(count), \" # not a \\\"comment\\\"\"); # a comment \"\n" 4000 lines)
+set(script "${WORK}/big.ccpp")
+file(WRITE "${script}" "${head}${lines}println(\"done after \", count);\n")
+file(SIZE "${script}" size)
+if(size LESS 262144)
+    message(FATAL_ERROR "the script is only ${size} bytes")
+endif()
+
+execute_process(COMMAND "${INTERPRETER}" "${script}" OUTPUT_VARIABLE expected RESULT_VARIABLE status)
+if(NOT status EQUAL 0 OR NOT expected MATCHES "line 5000 # not a \"comment\"\ndone after 4000\n$")
+    message(FATAL_ERROR "the script didn't run from a file (${status}):\n${expected}")
+endif()
+foreach(flags "" "--no-fold" "--cps")
+    execute_process(COMMAND "${INTERPRETER}" ${flags} - INPUT_FILE "${script}" OUTPUT_VARIABLE actual RESULT_VARIABLE status)
+    if(NOT status EQUAL 0 OR NOT actual STREQUAL expected)
+        message(FATAL_ERROR "piped in with `${flags}` it exited with ${status} printing\n${actual}")
+    endif()
+endforeach()
+
+set(broken "${WORK}/broken.ccpp")
+file(WRITE "${broken}" "${head}${lines}x = (1 + ;\nprintln(\"after the error\");\n")
+string(REPLACE "done after 4000\n" "" before "${expected}")
+execute_process(COMMAND "${INTERPRETER}" - INPUT_FILE "${broken}" OUTPUT_VARIABLE actual ERROR_VARIABLE error RESULT_VARIABLE status)
+if(NOT status EQUAL 1 OR NOT actual STREQUAL before OR error STREQUAL "")
+    message(FATAL_ERROR "piped in with an error at the end it exited with ${status} printing\n${actual}${error}")
+endif()
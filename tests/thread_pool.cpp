@@ -0,0 +1,50 @@
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+
+#include "ccpp.thread_pool.hpp"
+
+// thread_pool test: run() called from tasks of the same pool finishes with every
+// worker busy, covers every index once, and hands back the exception fn throws
+int main()
+{
+    int failures = 0;
+    for (std::size_t workers : {1, 2, 4})
+    {
+        ccpp::thread_pool pool(workers);
+        for (int round = 0; round < 50; round++)
+        {
+            std::atomic<long> sum = 0;
+            pool.run(8, [&](std::size_t i)
+                     { pool.run(50, [&](std::size_t j)
+                                { sum += static_cast<long>(i * 100 + j); }); });
+            // every i * 100 + j for i < 8 and j < 50, once
+            long expected = 50 * (100 * 28) + 8 * (49 * 50 / 2);
+            if (sum != expected)
+            {
+                std::cout << workers << " workers: nested run() covered the indices wrong" << std::endl;
+                failures++;
+                break;
+            }
+        }
+        bool thrown = false;
+        try
+        {
+            pool.run(100, [](std::size_t i)
+                     {
+                if (i == 57)
+                    throw std::runtime_error("57"); });
+        }
+        catch (const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        if (!thrown)
+        {
+            std::cout << workers << " workers: the exception was lost" << std::endl;
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
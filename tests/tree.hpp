@@ -0,0 +1,106 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ccpp.ast.hpp"
+
+// compares trees built by different parsers, whose node ids (arena offsets) and
+// symbol ids may differ
+namespace test
+{
+    struct entry
+    {
+        ccpp::node_kind kind;
+        std::uint8_t op;
+        std::uint16_t flags;
+        std::uint32_t count;
+        ccpp::source_span span;
+        std::string payload;
+
+        bool operator==(const entry &other) const
+        {
+            return kind == other.kind && op == other.op && flags == other.flags && count == other.count &&
+                   span.begin == other.span.begin && span.end == other.span.end && payload == other.payload;
+        }
+    };
+
+    // the nodes under `id` in pre-order. node ids are arena offsets and differ
+    // between the two parses, names are compared by their text
+    inline void flatten(const ccpp::ast &tree, ccpp::node_id id, std::vector<entry> &out)
+    {
+        if (id == ccpp::no_node)
+            return;
+        auto &head = tree.at(id);
+        auto &e = out.emplace_back(entry{head.kind, head.op, head.flags, head.count, head.span, {}});
+        switch (head.kind)
+        {
+        case ccpp::node_kind::num_t:
+        {
+            char buffer[32];
+            auto end = std::to_chars(buffer, buffer + sizeof(buffer), tree.get<ccpp::num_node>(id).value).ptr;
+            e.payload.assign(buffer, end);
+            break;
+        }
+        case ccpp::node_kind::str_t:
+            e.payload = tree.text(tree.get<ccpp::str_node>(id).value);
+            break;
+        case ccpp::node_kind::bool_t:
+            e.payload = tree.get<ccpp::bool_node>(id).value ? "true" : "false";
+            break;
+        case ccpp::node_kind::var_t:
+            e.payload = tree.symbols->name(tree.get<ccpp::var_node>(id).name);
+            break;
+        case ccpp::node_kind::assign_t:
+        case ccpp::node_kind::binary_t:
+        {
+            auto &n = tree.get<ccpp::binary_node>(id);
+            flatten(tree, n.left, out);
+            flatten(tree, n.right, out);
+            break;
+        }
+        case ccpp::node_kind::call_t:
+            flatten(tree, tree.get<ccpp::call_node>(id).func, out);
+            for (auto arg : tree.children<ccpp::call_node>(id))
+                flatten(tree, arg, out);
+            break;
+        case ccpp::node_kind::if_t:
+        {
+            auto &n = tree.get<ccpp::if_node>(id);
+            flatten(tree, n.cond, out);
+            flatten(tree, n.then, out);
+            flatten(tree, n.else_, out);
+            break;
+        }
+        case ccpp::node_kind::lambda_t:
+            for (auto var : tree.children<ccpp::lambda_node>(id))
+                flatten(tree, var, out);
+            flatten(tree, tree.get<ccpp::lambda_node>(id).body, out);
+            break;
+        case ccpp::node_kind::prog_t:
+            for (auto item : tree.children<ccpp::prog_node>(id))
+                flatten(tree, item, out);
+            break;
+        }
+    }
+
+    // where trees `expected` and `actual` differ, or empty
+    inline std::string compare(const ccpp::ast &expected, const ccpp::ast &actual)
+    {
+        std::vector<entry> want, got;
+        flatten(expected, expected.root, want);
+        flatten(actual, actual.root, got);
+        if (actual.nodes() != expected.nodes())
+            return std::to_string(actual.nodes()) + " nodes instead of " + std::to_string(expected.nodes());
+        for (std::size_t i = 0; i < want.size() && i < got.size(); i++)
+            if (!(got[i] == want[i]))
+                return "node " + std::to_string(i) + " (" + std::string(ccpp::to_string(want[i].kind)) + " at " +
+                       std::to_string(want[i].span.begin) + ") differs";
+        if (got.size() != want.size())
+            return std::to_string(got.size()) + " nodes reached instead of " + std::to_string(want.size());
+        return {};
+    }
+} // namespace test